@@ -92,6 +92,30 @@ auto Emulator::get(const std::string& name) -> std::string
     if(name == "bank3") {
         return app::Globals::bank3;
     }
+    if(name == "sio0.rx") {
+        return (app::Globals::replay.empty() != false ? "0" : "-1");
+    }
+    if(name == "sio0.tx") {
+        return "1";
+    }
+    if(name == "memory") {
+        return app::Globals::memory;
+    }
+    if(name == "fifo") {
+        return std::to_string(app::Globals::fifo);
+    }
+    if(name == "rtscts") {
+        return (app::Globals::rtscts != false ? "yes" : "no");
+    }
+    if(name == "record") {
+        return app::Globals::record;
+    }
+    if(name == "replay") {
+        return app::Globals::replay;
+    }
+    if(name == "sio.polled") {
+        return "no";
+    }
     throw std::runtime_error("unknown setting");
 }
 
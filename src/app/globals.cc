@@ -43,6 +43,11 @@ namespace app {
 
 bool        Globals::verbose = false;
 bool        Globals::turbo   = false;
+bool        Globals::rtscts  = false;
+uint32_t    Globals::fifo    = 4096;
+std::string Globals::memory  = "64k";
+std::string Globals::record  = "";
+std::string Globals::replay  = "";
 std::string Globals::bank0   = "assets/zexall.rom";
 std::string Globals::bank1   = "assets/bank1.rom";
 std::string Globals::bank2   = "assets/bank2.rom";
@@ -27,6 +27,11 @@ struct Globals
 {
     static bool        verbose;
     static bool        turbo;
+    static bool        rtscts;
+    static uint32_t    fifo;
+    static std::string memory;
+    static std::string record;
+    static std::string replay;
     static std::string bank0;
     static std::string bank1;
     static std::string bank2;
@@ -120,6 +120,21 @@ auto Program::init(const ArgList& args) -> bool
             else if(arg == "--turbo") {
                 Globals::turbo = true;
             }
+            else if(arg == "--rtscts") {
+                Globals::rtscts = true;
+            }
+            else if(arg_is(arg, "--fifo")) {
+                Globals::fifo = std::stoul(arg_val(arg));
+            }
+            else if((arg == "--memory=64k") || (arg == "--memory=512k")) {
+                Globals::memory = arg_val(arg);
+            }
+            else if(arg_is(arg, "--record")) {
+                Globals::record = arg_val(arg);
+            }
+            else if(arg_is(arg, "--replay")) {
+                Globals::replay = arg_val(arg);
+            }
             else if(arg_is(arg, "--bank0")) {
                 Globals::bank0 = arg_val(arg);
             }
@@ -184,14 +199,19 @@ auto Program::main(const ArgList& args) -> void
     auto do_main = [&](std::ostream& stream) -> void
     {
         if(Globals::verbose != false) {
-            stream << "Z80 Virtual Machine"                               << std::endl;
-            stream << ""                                                  << std::endl;
-            stream << "  - turbo" << " ... " << yes_or_no(Globals::turbo) << std::endl;
-            stream << "  - bank0" << " ... " << Globals::bank0            << std::endl;
-            stream << "  - bank1" << " ... " << Globals::bank1            << std::endl;
-            stream << "  - bank2" << " ... " << Globals::bank2            << std::endl;
-            stream << "  - bank3" << " ... " << Globals::bank3            << std::endl;
-            stream << ""                                                  << std::endl;
+            stream << "Z80 Virtual Machine"                                << std::endl;
+            stream << ""                                                   << std::endl;
+            stream << "  - turbo" << " ... " << yes_or_no(Globals::turbo)  << std::endl;
+            stream << "  - rtscts" << " .. " << yes_or_no(Globals::rtscts) << std::endl;
+            stream << "  - fifo" << " .... " << Globals::fifo              << std::endl;
+            stream << "  - memory" << " .. " << Globals::memory            << std::endl;
+            stream << "  - record" << " .. " << Globals::record            << std::endl;
+            stream << "  - replay" << " .. " << Globals::replay            << std::endl;
+            stream << "  - bank0" << " ... " << Globals::bank0             << std::endl;
+            stream << "  - bank1" << " ... " << Globals::bank1             << std::endl;
+            stream << "  - bank2" << " ... " << Globals::bank2             << std::endl;
+            stream << "  - bank3" << " ... " << Globals::bank3             << std::endl;
+            stream << ""                                                   << std::endl;
         }
         return main_loop();
     };
@@ -212,6 +232,11 @@ auto Program::help(const ArgList& args) -> void
         stream << "  -q, --quiet                   quiet mode"                         << std::endl;
         stream << ""                                                                   << std::endl;
         stream << "  --turbo                       run the emulation at maximum speed" << std::endl;
+        stream << "  --rtscts                      enable the rts/cts flow control"    << std::endl;
+        stream << "  --fifo={size}                 specifies the rx fifo size (bytes)" << std::endl;
+        stream << "  --memory={64k|512k}           specifies the memory layout"        << std::endl;
+        stream << "  --record={filename}           records the serial input to a file" << std::endl;
+        stream << "  --replay={filename}           replays the serial input of a file" << std::endl;
         stream << "  --bank0={filename}            specifies the ram bank #0 (16kB)"   << std::endl;
         stream << "  --bank1={filename}            specifies the ram bank #1 (16kB)"   << std::endl;
         stream << "  --bank2={filename}            specifies the ram bank #2 (16kB)"   << std::endl;
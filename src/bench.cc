@@ -0,0 +1,562 @@
+/*
+ * bench.cc - Copyright (c) 2001-2026 - Olivier Poncet
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cstdarg>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <unistd.h>
+#include <fcntl.h>
+#include "emu/virtual-machine.h"
+
+// ---------------------------------------------------------------------------
+// <anonymous>::aliases
+// ---------------------------------------------------------------------------
+
+namespace {
+
+using ClockType = std::chrono::steady_clock;
+using TimePoint = std::chrono::time_point<ClockType>;
+using Bytes     = std::vector<uint8_t>;
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::Result
+// ---------------------------------------------------------------------------
+
+namespace {
+
+struct Result
+{
+    std::string group;
+    std::string unit;
+    double      value;
+};
+
+using Results = std::vector<Result>;
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::Pattern
+// ---------------------------------------------------------------------------
+
+/*
+ * each pattern is repeated from PATTERN_ADDR up to PATTERN_SIZE bytes and
+ * closed by a jump back to its start. every pattern writes to the memory so
+ * the idle loop detection of the cpu never kicks in. the preamble sets the
+ * stack and the index registers to a scratch area far from the code.
+ */
+
+namespace {
+
+constexpr uint16_t PATTERN_ADDR   = 0x0100;
+constexpr uint16_t PATTERN_SIZE   = 0x0800;
+constexpr uint32_t PATTERN_STATES = 100000000;
+constexpr uint32_t PATTERN_BUDGET = 1000000;
+
+struct Pattern
+{
+    const char* group;
+    Bytes       bytes;
+};
+
+const Bytes PREAMBLE = {
+    0xf3,                   /* di            */
+    0x31, 0x00, 0xf0,       /* ld sp,$f000   */
+    0xdd, 0x21, 0x00, 0xc0, /* ld ix,$c000   */
+    0xfd, 0x21, 0x00, 0xc1, /* ld iy,$c100   */
+    0x21, 0x00, 0xc2,       /* ld hl,$c200   */
+    0xc3, 0x00, 0x01,       /* jp $0100      */
+};
+
+const std::vector<Pattern> PATTERNS = {
+    { "base", {
+        0x78,                   /* ld a,b        */
+        0x81,                   /* add a,c       */
+        0x04,                   /* inc b         */
+        0x0d,                   /* dec c         */
+        0x3e, 0x12,             /* ld a,$12      */
+        0xa9,                   /* xor c         */
+        0x32, 0x00, 0xc0,       /* ld ($c000),a  */
+        0x3a, 0x01, 0xc0,       /* ld a,($c001)  */
+        0x23,                   /* inc hl        */
+        0x2b,                   /* dec hl        */
+        0xe5,                   /* push hl       */
+        0xe1,                   /* pop hl        */
+        0x00,                   /* nop           */
+    } },
+    { "alu", {
+        0x80,                   /* add a,b       */
+        0x89,                   /* adc a,c       */
+        0x92,                   /* sub d         */
+        0x9b,                   /* sbc a,e       */
+        0xbc,                   /* cp h          */
+        0x27,                   /* daa           */
+        0x04,                   /* inc b         */
+        0x15,                   /* dec d         */
+        0xce, 0x5a,             /* adc a,$5a     */
+        0xde, 0x3c,             /* sbc a,$3c     */
+        0xfe, 0x80,             /* cp $80        */
+        0x1c,                   /* inc e         */
+        0x0d,                   /* dec c         */
+        0x32, 0x00, 0xc0,       /* ld ($c000),a  */
+    } },
+    { "cb", {
+        0xcb, 0x07,             /* rlc a         */
+        0xcb, 0x38,             /* srl b         */
+        0xcb, 0x41,             /* bit 0,c       */
+        0xcb, 0xc2,             /* set 0,d       */
+        0xcb, 0x83,             /* res 0,e       */
+        0xcb, 0x46,             /* bit 0,(hl)    */
+        0xcb, 0x16,             /* rl (hl)       */
+    } },
+    { "ed", {
+        0xed, 0x44,             /* neg           */
+        0xed, 0x4a,             /* adc hl,bc     */
+        0xed, 0x42,             /* sbc hl,bc     */
+        0xed, 0x57,             /* ld a,i        */
+        0xed, 0x5f,             /* ld a,r        */
+        0xed, 0x43, 0x00, 0xc0, /* ld ($c000),bc */
+        0xed, 0x4b, 0x02, 0xc0, /* ld bc,($c002) */
+    } },
+    { "dd/fd", {
+        0xdd, 0x7e, 0x01,       /* ld a,(ix+1)   */
+        0xdd, 0x77, 0x02,       /* ld (ix+2),a   */
+        0xdd, 0x86, 0x03,       /* add a,(ix+3)  */
+        0xdd, 0x23,             /* inc ix        */
+        0xdd, 0x2b,             /* dec ix        */
+        0xfd, 0x34, 0x04,       /* inc (iy+4)    */
+        0xfd, 0x7e, 0x05,       /* ld a,(iy+5)   */
+        0xfd, 0xe5,             /* push iy       */
+        0xfd, 0xe1,             /* pop iy        */
+    } },
+    { "ddcb/fdcb", {
+        0xdd, 0xcb, 0x01, 0x06, /* rlc (ix+1)    */
+        0xdd, 0xcb, 0x02, 0x46, /* bit 0,(ix+2)  */
+        0xdd, 0xcb, 0x03, 0xc6, /* set 0,(ix+3)  */
+        0xfd, 0xcb, 0x04, 0x8e, /* res 1,(iy+4)  */
+        0xfd, 0xcb, 0x05, 0x1e, /* rr (iy+5)     */
+        0xfd, 0xcb, 0x06, 0x7e, /* bit 7,(iy+6)  */
+    } },
+    { "block", {
+        0x21, 0x00, 0xc0,       /* ld hl,$c000   */
+        0x11, 0x00, 0xc8,       /* ld de,$c800   */
+        0x01, 0x00, 0x04,       /* ld bc,$0400   */
+        0xed, 0xb0,             /* ldir          */
+        0x21, 0xff, 0xc3,       /* ld hl,$c3ff   */
+        0x11, 0xff, 0xcb,       /* ld de,$cbff   */
+        0x01, 0x00, 0x04,       /* ld bc,$0400   */
+        0xed, 0xb8,             /* lddr          */
+        0x3e, 0xaa,             /* ld a,$aa      */
+        0x21, 0x00, 0xc8,       /* ld hl,$c800   */
+        0x01, 0x00, 0x04,       /* ld bc,$0400   */
+        0xed, 0xb1,             /* cpir          */
+    } },
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::CpuBench
+// ---------------------------------------------------------------------------
+
+/*
+ * the cpu is benchmarked alone on top of the mmu. a first pass over the
+ * pattern is single-stepped to count its instructions (each iteration of a
+ * block instruction counts as one) and its T-states, then the pattern is run
+ * with large budgets and timed.
+ */
+
+namespace {
+
+class CpuBench final
+    : private cpu::Interface
+    , private mmu::Interface
+{
+public: // public interface
+    CpuBench()
+        : _cpu(*this)
+        , _mmu(*this, false)
+    {
+        _cpu.set_rd_pages(_mmu.rd_pages());
+    }
+
+    auto run(const Pattern& pattern, Results& results) -> void
+    {
+        uint32_t instructions = 0;
+        uint32_t t_states     = 0;
+
+        auto load = [&]() -> void
+        {
+            uint32_t addr = 0x0000;
+            _mmu.reset();
+            for(auto byte : PREAMBLE) {
+                _mmu.wr_byte(addr++, byte);
+            }
+            addr = PATTERN_ADDR;
+            while((addr + pattern.bytes.size()) < (PATTERN_ADDR + PATTERN_SIZE)) {
+                for(auto byte : pattern.bytes) {
+                    _mmu.wr_byte(addr++, byte);
+                }
+            }
+            _mmu.wr_byte(addr++, 0xc3);
+            _mmu.wr_byte(addr++, (PATTERN_ADDR >> 0) & 0xff);
+            _mmu.wr_byte(addr++, (PATTERN_ADDR >> 8) & 0xff);
+            _cpu.reset();
+        };
+
+        auto at_start = [&]() -> bool
+        {
+            return (_cpu->r_pc.w.l == PATTERN_ADDR) && (_cpu->i_period == 0);
+        };
+
+        auto calibrate = [&]() -> void
+        {
+            while(at_start() == false) {
+                _cpu.run(1);
+            }
+            const uint32_t start = _cpu->t_states;
+            do {
+                if(_cpu->i_period == 0) {
+                    ++instructions;
+                }
+                _cpu.run(1);
+            } while(at_start() == false);
+            t_states = _cpu->t_states - start;
+        };
+
+        auto measure = [&]() -> void
+        {
+            uint64_t  consumed = 0;
+            TimePoint t0(ClockType::now());
+            while(consumed < PATTERN_STATES) {
+                consumed += _cpu.run(PATTERN_BUDGET);
+            }
+            TimePoint t1(ClockType::now());
+
+            const double seconds = std::chrono::duration<double>(t1 - t0).count();
+            const double count   = (static_cast<double>(consumed) * instructions) / t_states;
+            results.push_back(Result{pattern.group, "ns/instr", (seconds * 1e9) / count});
+            results.push_back(Result{pattern.group, "MIPS",     (count / seconds) / 1e6});
+            results.push_back(Result{pattern.group, "MHz",      (consumed / seconds) / 1e6});
+        };
+
+        load();
+        calibrate();
+        measure();
+    }
+
+private: // private cpu interface
+    virtual auto cpu_mreq_m1(cpu::Instance&, uint16_t addr, uint8_t data) -> uint8_t override final
+    {
+        return _mmu.rd_byte(addr, data);
+    }
+
+    virtual auto cpu_mreq_rd(cpu::Instance&, uint16_t addr, uint8_t data) -> uint8_t override final
+    {
+        return _mmu.rd_byte(addr, data);
+    }
+
+    virtual auto cpu_mreq_wr(cpu::Instance&, uint16_t addr, uint8_t data) -> uint8_t override final
+    {
+        return _mmu.wr_byte(addr, data);
+    }
+
+    virtual auto cpu_iorq_m1(cpu::Instance&, uint16_t port, uint8_t data) -> uint8_t override final
+    {
+        return 0x00;
+    }
+
+    virtual auto cpu_iorq_rd(cpu::Instance&, uint16_t port, uint8_t data) -> uint8_t override final
+    {
+        return 0xff;
+    }
+
+    virtual auto cpu_iorq_wr(cpu::Instance&, uint16_t port, uint8_t data) -> uint8_t override final
+    {
+        return data;
+    }
+
+private: // private mmu interface
+    virtual auto mmu_char_wr(mmu::Instance&, uint8_t data) -> void override final
+    {
+    }
+
+    virtual auto mmu_page_sw(mmu::Instance&, uint16_t addr, uint32_t size) -> void override final
+    {
+        _cpu.flush(addr, size);
+    }
+
+    virtual auto mmu_page_rd(mmu::Instance&, uint32_t addr, uint8_t data) -> uint8_t override final
+    {
+        return data;
+    }
+
+    virtual auto mmu_page_wr(mmu::Instance&, uint32_t addr, uint8_t data) -> uint8_t override final
+    {
+        return data;
+    }
+
+private: // private data
+    cpu::Instance _cpu;
+    mmu::Instance _mmu;
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::Redirect
+// ---------------------------------------------------------------------------
+
+/*
+ * the serial port of the virtual machine is wired to the standard input and
+ * output. while the virtual machine is benchmarked, the input is replaced by
+ * a pipe that never gets any data and the output is discarded.
+ */
+
+namespace {
+
+class Redirect
+{
+public: // public interface
+    Redirect()
+        : _stdin(::dup(0))
+        , _stdout(::dup(1))
+        , _pipe{-1, -1}
+    {
+        if((_stdin < 0) || (_stdout < 0) || (::pipe(_pipe) != 0)) {
+            throw std::runtime_error("Redirect() has failed");
+        }
+        const int null = ::open("/dev/null", O_WRONLY);
+        if(null < 0) {
+            throw std::runtime_error("open() has failed");
+        }
+        std::cout.flush();
+        static_cast<void>(::dup2(_pipe[0], 0));
+        static_cast<void>(::dup2(null, 1));
+        static_cast<void>(::close(null));
+    }
+
+    Redirect(const Redirect&) = delete;
+
+    Redirect& operator=(const Redirect&) = delete;
+
+    virtual ~Redirect()
+    {
+        static_cast<void>(::dup2(_stdin, 0));
+        static_cast<void>(::dup2(_stdout, 1));
+        static_cast<void>(::close(_stdin));
+        static_cast<void>(::close(_stdout));
+        static_cast<void>(::close(_pipe[0]));
+        static_cast<void>(::close(_pipe[1]));
+    }
+
+private: // private data
+    int _stdin;
+    int _stdout;
+    int _pipe[2];
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::VmBench
+// ---------------------------------------------------------------------------
+
+/*
+ * the whole virtual machine is benchmarked in turbo mode on its stock roms.
+ * each call to clock() emulates one video frame, the emulated clock is then
+ * derived from the cpu clock and the vertical frequency.
+ */
+
+namespace {
+
+constexpr uint32_t VM_FRAMES = 600;
+
+class VmBench final
+    : private emu::VirtualMachineIface
+{
+public: // public interface
+    VmBench(const std::string& group, const std::string& rom)
+        : _group(group)
+        , _rom(rom)
+    {
+    }
+
+    auto run(Results& results) -> void
+    {
+        const emu::VirtualMachineState vm_state;
+        const vdu::State               vdu_state;
+        double                         seconds = 0.0;
+
+        auto measure = [&]() -> void
+        {
+            const Redirect redirect;
+            emu::VirtualMachine vm(*this);
+            vm.reset();
+            TimePoint t0(ClockType::now());
+            for(uint32_t frame = 0; frame < VM_FRAMES; ++frame) {
+                vm.clock();
+            }
+            TimePoint t1(ClockType::now());
+            seconds = std::chrono::duration<double>(t1 - t0).count();
+        };
+
+        measure();
+
+        const double emulated = (static_cast<double>(VM_FRAMES) * vm_state.cpu_clock) / vdu_state.vfreq;
+        results.push_back(Result{_group, "MHz", (emulated / seconds) / 1e6});
+    }
+
+private: // private vm interface
+    virtual auto loop() -> void override final
+    {
+    }
+
+    virtual auto quit() -> void override final
+    {
+    }
+
+    virtual auto get(const std::string& name) -> std::string override final
+    {
+        if(name == "bank0") {
+            return _rom;
+        }
+        if(name == "bank1") {
+            return "assets/bank1.rom";
+        }
+        if(name == "bank2") {
+            return "assets/bank2.rom";
+        }
+        if(name == "bank3") {
+            return "assets/bank3.rom";
+        }
+        if(name == "sio0.rx") {
+            return "0";
+        }
+        if(name == "sio0.tx") {
+            return "1";
+        }
+        if(name == "memory") {
+            return "64k";
+        }
+        if(name == "fifo") {
+            return "4096";
+        }
+        if(name == "rtscts") {
+            return "no";
+        }
+        if(name == "record") {
+            return "";
+        }
+        if(name == "replay") {
+            return "";
+        }
+        if(name == "sio.polled") {
+            return "no";
+        }
+        throw std::runtime_error("unknown setting");
+    }
+
+private: // private data
+    const std::string _group;
+    const std::string _rom;
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::report
+// ---------------------------------------------------------------------------
+
+namespace {
+
+auto report(const Results& results, const std::string& filename) -> void
+{
+    auto print_table = [&](std::ostream& stream) -> void
+    {
+        stream << std::left  << std::setw(16) << "group"
+               << std::left  << std::setw(10) << "unit"
+               << std::right << std::setw(12) << "value"
+               << std::endl;
+        for(auto& result : results) {
+            stream << std::left  << std::setw(16) << result.group
+                   << std::left  << std::setw(10) << result.unit
+                   << std::right << std::setw(12) << std::fixed << std::setprecision(3) << result.value
+                   << std::endl;
+        }
+    };
+
+    auto write_file = [&]() -> void
+    {
+        std::ofstream stream(filename);
+        if(stream.good() == false) {
+            throw std::runtime_error(std::string("unable to open") + ' ' + '\'' + filename + '\'');
+        }
+        for(auto& result : results) {
+            stream << result.group << '\t' << result.unit << '\t' << result.value << '\n';
+        }
+    };
+
+    print_table(std::cout);
+    write_file();
+}
+
+}
+
+// ---------------------------------------------------------------------------
+// main
+// ---------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+    const std::string filename(argc > 1 ? argv[1] : "virtz80-bench.tsv");
+
+    try {
+        Results results;
+        for(auto& pattern : PATTERNS) {
+            CpuBench().run(pattern, results);
+        }
+        VmBench("vm/zexall",  "assets/zexall.rom").run(results);
+        VmBench("vm/basic",   "assets/basic.rom").run(results);
+        VmBench("vm/monitor", "assets/monitor.rom").run(results);
+        report(results, filename);
+    }
+    catch(const std::exception& e) {
+        std::cerr << "error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+// ---------------------------------------------------------------------------
+// End-Of-File
+// ---------------------------------------------------------------------------
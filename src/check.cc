@@ -0,0 +1,615 @@
+/*
+ * check.cc - Copyright (c) 2001-2026 - Olivier Poncet
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cstdarg>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <string>
+#include <vector>
+#include <iomanip>
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <unistd.h>
+#include <fcntl.h>
+#include "emu/virtual-machine.h"
+
+// ---------------------------------------------------------------------------
+// <anonymous>::aliases
+// ---------------------------------------------------------------------------
+
+namespace {
+
+using ClockType = std::chrono::steady_clock;
+using TimePoint = std::chrono::time_point<ClockType>;
+using Snapshot  = emu::VirtualMachineSnapshot;
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::zex
+// ---------------------------------------------------------------------------
+
+/*
+ * the exerciser walks a null-terminated table of pointers to its test groups:
+ *
+ *   ld hl,tests / loop: ld a,(hl) / inc hl / or (hl) / jp z,done
+ *
+ * this sequence is looked up in the loaded image, so the runner works with
+ * both zexall and zexdoc without hardcoding any address. the boot code of
+ * the images rewrites the operand of the `ld hl` before jumping to the
+ * exerciser, so a shard patches the entries of the table instead.
+ */
+
+namespace {
+
+constexpr char ZEX_HEADER[] = "Z80 instruction exerciser\n\r";
+constexpr char ZEX_FOOTER[] = "Tests complete";
+
+struct Exerciser
+{
+    std::string filename;
+    Snapshot    snapshot;
+    uint16_t    tests;
+    uint16_t    count;
+};
+
+auto peek(const Snapshot& snapshot, uint16_t addr) -> uint8_t
+{
+    return snapshot.mmu.bank[(addr >> 14) & 3].data[addr & 0x3fff];
+}
+
+auto poke(Snapshot& snapshot, uint16_t addr, uint8_t data) -> void
+{
+    snapshot.mmu.bank[(addr >> 14) & 3].data[addr & 0x3fff] = data;
+}
+
+auto locate(Exerciser& exerciser) -> void
+{
+    static const uint8_t pattern[] = { 0x21, 0x00, 0x00, 0x7e, 0x23, 0xb6, 0xca };
+
+    auto matches = [&](const uint16_t addr) -> bool
+    {
+        for(uint16_t index = 0; index < sizeof(pattern); ++index) {
+            if((index == 1) || (index == 2)) {
+                continue;
+            }
+            if(peek(exerciser.snapshot, addr + index) != pattern[index]) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    for(uint32_t addr = 0x0000; addr < (0x10000 - sizeof(pattern)); ++addr) {
+        if(matches(addr)) {
+            exerciser.tests = peek(exerciser.snapshot, addr + 1) | (peek(exerciser.snapshot, addr + 2) << 8);
+            exerciser.count = 0;
+            while((peek(exerciser.snapshot, exerciser.tests + (exerciser.count * 2) + 0) != 0)
+               || (peek(exerciser.snapshot, exerciser.tests + (exerciser.count * 2) + 1) != 0)) {
+                ++exerciser.count;
+            }
+            return;
+        }
+    }
+    throw std::runtime_error(std::string("no test table found in") + ' ' + '\'' + exerciser.filename + '\'');
+}
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::Machine
+// ---------------------------------------------------------------------------
+
+/*
+ * a virtual machine whose serial output goes to the given file descriptor
+ * and which runs until the exerciser halts it.
+ */
+
+namespace {
+
+class Machine final
+    : private emu::VirtualMachineIface
+{
+public: // public interface
+    Machine(const std::string& rom, int tx)
+        : _rom(rom)
+        , _tx(tx)
+        , _quit(false)
+        , _vm(*this)
+    {
+    }
+
+    auto reset() -> void
+    {
+        _vm.reset();
+    }
+
+    auto snapshot(Snapshot& snapshot) -> void
+    {
+        _vm.snapshot(snapshot);
+    }
+
+    auto restore(const Snapshot& snapshot) -> void
+    {
+        _vm.restore(snapshot);
+    }
+
+    auto run() -> void
+    {
+        while(_quit == false) {
+            _vm.clock();
+        }
+    }
+
+private: // private vm interface
+    virtual auto loop() -> void override final
+    {
+    }
+
+    virtual auto quit() -> void override final
+    {
+        _quit = true;
+    }
+
+    virtual auto get(const std::string& name) -> std::string override final
+    {
+        if(name == "bank0") {
+            return _rom;
+        }
+        if(name == "bank1") {
+            return "assets/bank1.rom";
+        }
+        if(name == "bank2") {
+            return "assets/bank2.rom";
+        }
+        if(name == "bank3") {
+            return "assets/bank3.rom";
+        }
+        if(name == "sio0.rx") {
+            return "-1";
+        }
+        if(name == "sio0.tx") {
+            return std::to_string(_tx);
+        }
+        if(name == "memory") {
+            return "64k";
+        }
+        if(name == "fifo") {
+            return "4096";
+        }
+        if(name == "rtscts") {
+            return "no";
+        }
+        if(name == "record") {
+            return "";
+        }
+        if(name == "replay") {
+            return "";
+        }
+        if(name == "sio.polled") {
+            return "no";
+        }
+        throw std::runtime_error("unknown setting");
+    }
+
+private: // private data
+    const std::string   _rom;
+    const int           _tx;
+    bool                _quit;
+    emu::VirtualMachine _vm;
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::Shard
+// ---------------------------------------------------------------------------
+
+/*
+ * a shard runs a single test group. the snapshot taken right after the reset
+ * is patched so that the first entry of the table points to the group and
+ * the second one ends the walk, the output of the shard is captured through
+ * a pipe.
+ */
+
+namespace {
+
+struct Shard
+{
+    const Exerciser* exerciser;
+    uint16_t         group;
+    std::string      output;
+};
+
+auto run_shard(Shard& shard) -> void
+{
+    const Exerciser& exerciser(*shard.exerciser);
+    int              fds[2] = { -1, -1 };
+
+    auto patch = [&](Snapshot& snapshot) -> void
+    {
+        const uint16_t first = exerciser.tests;
+        const uint16_t after = exerciser.tests + 2;
+        const uint16_t entry = exerciser.tests + (shard.group * 2);
+        poke(snapshot, first + 0, peek(snapshot, entry + 0));
+        poke(snapshot, first + 1, peek(snapshot, entry + 1));
+        poke(snapshot, after + 0, 0x00);
+        poke(snapshot, after + 1, 0x00);
+    };
+
+    auto execute = [&]() -> void
+    {
+        std::unique_ptr<Snapshot> snapshot(new Snapshot(exerciser.snapshot));
+        std::unique_ptr<Machine>  machine(new Machine(exerciser.filename, fds[1]));
+        patch(*snapshot);
+        machine->restore(*snapshot);
+        machine->run();
+    };
+
+    auto collect = [&]() -> void
+    {
+        char buffer[256];
+        ssize_t rc = 0;
+        while((rc = ::read(fds[0], buffer, sizeof(buffer))) > 0) {
+            shard.output.append(buffer, rc);
+        }
+    };
+
+    if(::pipe(fds) != 0) {
+        throw std::runtime_error("pipe() has failed");
+    }
+    try {
+        execute();
+        fds[1] = (::close(fds[1]), -1);
+        collect();
+        fds[0] = (::close(fds[0]), -1);
+    }
+    catch(...) {
+        for(auto fd : fds) {
+            if(fd != -1) {
+                static_cast<void>(::close(fd));
+            }
+        }
+        throw;
+    }
+}
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::ThreadPool
+// ---------------------------------------------------------------------------
+
+/*
+ * the shards are dealt round-robin to per-worker queues. a worker takes its
+ * own shards from the front of its queue and, once it is empty, steals from
+ * the back of the other queues, so a worker stuck with a long group does not
+ * hold back the others.
+ */
+
+namespace {
+
+class ThreadPool
+{
+public: // public interface
+    ThreadPool(unsigned workers)
+        : _queues()
+    {
+        for(unsigned index = 0; index < (workers != 0 ? workers : 1); ++index) {
+            _queues.emplace_back(new Queue());
+        }
+    }
+
+    auto run(std::vector<Shard>& shards) -> void
+    {
+        std::vector<std::thread> threads;
+        std::exception_ptr       failure;
+        std::mutex               failure_mutex;
+
+        auto worker = [&](const size_t self) -> void
+        {
+            size_t shard = 0;
+            while(take(self, shard)) {
+                try {
+                    run_shard(shards[shard]);
+                }
+                catch(...) {
+                    std::lock_guard<std::mutex> lock(failure_mutex);
+                    if(failure == nullptr) {
+                        failure = std::current_exception();
+                    }
+                }
+            }
+        };
+
+        for(size_t index = 0; index < shards.size(); ++index) {
+            _queues[index % _queues.size()]->shards.push_back(index);
+        }
+        for(size_t index = 0; index < _queues.size(); ++index) {
+            threads.emplace_back(worker, index);
+        }
+        for(auto& thread : threads) {
+            thread.join();
+        }
+        if(failure != nullptr) {
+            std::rethrow_exception(failure);
+        }
+    }
+
+private: // private types
+    struct Queue
+    {
+        std::mutex         mutex;
+        std::deque<size_t> shards;
+    };
+
+private: // private interface
+    auto take(const size_t self, size_t& shard) -> bool
+    {
+        for(size_t offset = 0; offset < _queues.size(); ++offset) {
+            Queue& queue(*_queues[(self + offset) % _queues.size()]);
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if(queue.shards.empty() == false) {
+                if(offset == 0) {
+                    shard = queue.shards.front();
+                    queue.shards.pop_front();
+                }
+                else {
+                    shard = queue.shards.back();
+                    queue.shards.pop_back();
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+private: // private data
+    std::vector<std::unique_ptr<Queue>> _queues;
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::flood
+// ---------------------------------------------------------------------------
+
+/*
+ * a serial port prints many times its transmit queue into a pipe whose reader
+ * starts late, so the queue and the pipe are full long before the end. every
+ * byte must come out, in order, with a worker thread and with a polled port.
+ */
+
+namespace {
+
+constexpr uint32_t FLOOD_BYTES = 262144;
+constexpr uint32_t FLOOD_DELAY = 50;
+
+class Flood final
+    : private sio::Interface
+{
+public: // public interface
+    Flood() = default;
+
+    auto run(const bool polled) -> bool
+    {
+        int         fds[2] = { -1, -1 };
+        std::string output;
+
+        if(::pipe(fds) != 0) {
+            throw std::runtime_error("pipe() has failed");
+        }
+        if(polled != false) {
+            static_cast<void>(::fcntl(fds[1], F_SETFL, O_NONBLOCK));
+        }
+        std::thread reader([&]() -> void
+        {
+            char buffer[4096];
+            std::this_thread::sleep_for(std::chrono::milliseconds(FLOOD_DELAY));
+            for(;;) {
+                const ssize_t rc = ::read(fds[0], buffer, sizeof(buffer));
+                if(rc > 0) {
+                    output.append(buffer, rc);
+                }
+                else if((rc == 0) || (errno != EINTR)) {
+                    break;
+                }
+            }
+        });
+        {
+            sio::Instance sio(*this, -1, fds[1], polled);
+            for(uint32_t index = 0; index < FLOOD_BYTES; ++index) {
+                static_cast<void>(sio.print(pattern(index)));
+            }
+        }
+        static_cast<void>(::close(fds[1]));
+        reader.join();
+        static_cast<void>(::close(fds[0]));
+
+        uint32_t errors = (output.size() != FLOOD_BYTES ? 1 : 0);
+        for(uint32_t index = 0; (index < output.size()) && (errors == 0); ++index) {
+            if(static_cast<uint8_t>(output[index]) != pattern(index)) {
+                ++errors;
+            }
+        }
+        std::cout << "sio " << (polled != false ? "polled" : "threaded") << ':'
+                  << ' ' << output.size() << '/' << FLOOD_BYTES << ' ' << "bytes,"
+                  << ' ' << errors << ' ' << "errors"
+                  << std::endl;
+        return errors == 0;
+    }
+
+private: // private sio interface
+    virtual auto sio_intr_rq(sio::Instance&) -> void override final
+    {
+    }
+
+    virtual auto sio_rx_data(sio::Instance&, uint8_t&) -> bool override final
+    {
+        return false;
+    }
+
+    virtual auto sio_tx_data(sio::Instance&, uint8_t) -> bool override final
+    {
+        return true;
+    }
+
+    static auto pattern(const uint32_t index) -> uint8_t
+    {
+        return static_cast<uint8_t>((index * 7) + (index >> 8));
+    }
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::report
+// ---------------------------------------------------------------------------
+
+/*
+ * each shard prints the header, its own group and the footer. the groups are
+ * merged back in order between a single header and a single footer.
+ */
+
+namespace {
+
+auto report(const Exerciser& exerciser, const std::vector<Shard>& shards, double seconds) -> bool
+{
+    uint32_t errors = 0;
+
+    auto body_of = [&](const std::string& output) -> std::string
+    {
+        std::string body(output);
+        const size_t header = body.find(ZEX_HEADER);
+        if(header != std::string::npos) {
+            body.erase(0, header + (sizeof(ZEX_HEADER) - 1));
+        }
+        const size_t footer = body.find(ZEX_FOOTER);
+        if(footer != std::string::npos) {
+            body.erase(footer);
+        }
+        return body;
+    };
+
+    std::cout << ZEX_HEADER;
+    for(auto& shard : shards) {
+        if(shard.exerciser == &exerciser) {
+            const std::string body(body_of(shard.output));
+            if(body.find("ERROR") != std::string::npos) {
+                ++errors;
+            }
+            std::cout << body;
+        }
+    }
+    std::cout << ZEX_FOOTER << std::endl;
+    std::cout << exerciser.filename << ':'
+              << ' ' << exerciser.count << ' ' << "groups,"
+              << ' ' << errors << ' ' << "errors,"
+              << ' ' << std::fixed << std::setprecision(2) << seconds << 's'
+              << std::endl;
+    return errors == 0;
+}
+
+}
+
+// ---------------------------------------------------------------------------
+// main
+// ---------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> filenames;
+    unsigned                 workers = std::thread::hardware_concurrency();
+
+    auto parse = [&]() -> void
+    {
+        for(int argi = 1; argi < argc; ++argi) {
+            const std::string arg(argv[argi]);
+            if(arg.compare(0, 2, "-j") == 0) {
+                workers = std::stoul(arg.substr(2));
+            }
+            else {
+                filenames.push_back(arg);
+            }
+        }
+        if(filenames.empty()) {
+            filenames.push_back("assets/zexall.rom");
+            filenames.push_back("assets/zexdoc.rom");
+        }
+    };
+
+    auto boot = [&](Exerciser& exerciser) -> void
+    {
+        std::unique_ptr<Machine> machine(new Machine(exerciser.filename, -1));
+        machine->reset();
+        machine->snapshot(exerciser.snapshot);
+        locate(exerciser);
+    };
+
+    try {
+        parse();
+        bool passed = true;
+        for(const bool polled : { false, true }) {
+            if(Flood().run(polled) == false) {
+                passed = false;
+            }
+        }
+        std::vector<std::unique_ptr<Exerciser>> exercisers;
+        std::vector<Shard>                      shards;
+        for(auto& filename : filenames) {
+            exercisers.emplace_back(new Exerciser());
+            Exerciser& exerciser(*exercisers.back());
+            exerciser.filename = filename;
+            boot(exerciser);
+            for(uint16_t group = 0; group < exerciser.count; ++group) {
+                shards.push_back(Shard{&exerciser, group, std::string()});
+            }
+        }
+        const TimePoint t0(ClockType::now());
+        ThreadPool(workers).run(shards);
+        const TimePoint t1(ClockType::now());
+        const double seconds = std::chrono::duration<double>(t1 - t0).count();
+        for(auto& exerciser : exercisers) {
+            if(report(*exerciser, shards, seconds) == false) {
+                passed = false;
+            }
+        }
+        if(passed == false) {
+            return EXIT_FAILURE;
+        }
+    }
+    catch(const std::exception& e) {
+        std::cerr << "error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+// ---------------------------------------------------------------------------
+// End-Of-File
+// ---------------------------------------------------------------------------
@@ -17,15 +17,36 @@
 #ifndef __DEV_CPU_CORE_H__
 #define __DEV_CPU_CORE_H__
 
+// ---------------------------------------------------------------------------
+// build options
+// ---------------------------------------------------------------------------
+
+/*
+ * the dynamic recompiler emits x86-64 code for a little-endian unix host,
+ * elsewhere the option is dropped and the core keeps its interpreters. it
+ * translates the blocks of the block cache, which it then requires.
+ */
+
+#if defined(ENABLE_DYNAREC) && (!defined(__x86_64__) || !defined(__unix__) || defined(__EMSCRIPTEN__) || !defined(LSB_FIRST))
+#undef ENABLE_DYNAREC
+#endif
+
+#if defined(ENABLE_DYNAREC) && !defined(ENABLE_BLOCK_CACHE)
+#define ENABLE_BLOCK_CACHE
+#endif
+
 // ---------------------------------------------------------------------------
 // forward declarations
 // ---------------------------------------------------------------------------
 
 namespace cpu {
 
-class Instance;
+template <typename Bus>
+class Core;
 class Interface;
 
+using Instance = Core<Interface>;
+
 }
 
 // ---------------------------------------------------------------------------
@@ -98,38 +119,230 @@ struct State
 }
 
 // ---------------------------------------------------------------------------
-// cpu::Instance
+// cpu::Decoded
+// ---------------------------------------------------------------------------
+
+namespace cpu {
+
+struct Decoded
+{
+    const void* handler;  /* threaded handler      */
+    uint16_t    pc;       /* instruction address   */
+    uint16_t    next;     /* next instruction      */
+    uint16_t    operand;  /* immediate or target   */
+    uint16_t    t_states; /* T-States since sync   */
+    uint16_t    bound;    /* T-States upper bound  */
+    uint8_t     m_cycles; /* M-Cycles since sync   */
+    uint8_t     r_cycles; /* refresh since sync    */
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// cpu::DynarecContext
+// ---------------------------------------------------------------------------
+
+#ifdef ENABLE_DYNAREC
+
+namespace cpu {
+
+struct DynarecContext
+{
+    uint32_t            (*mreq_rd)(DynarecContext&, uint32_t addr);                /* read thunk          */
+    uint32_t            (*mreq_wr)(DynarecContext&, uint32_t addr, uint32_t data); /* write thunk         */
+    void*                 core;                                                    /* calling core        */
+    const uint8_t* const* pages;                                                   /* read pages          */
+    uint32_t              page;                                                    /* page of the block   */
+    uint32_t              generation;                                              /* generation of page  */
+    bool                  dirty;                                                   /* memory written      */
+};
+
+using DynarecCode = uint32_t (*)(State*, Register* wz, DynarecContext*);
+
+}
+
+#endif
+
+// ---------------------------------------------------------------------------
+// cpu::Dynarec
+// ---------------------------------------------------------------------------
+
+/*
+ * the dynamic recompiler translates the leading records of a decoded block
+ * into a native function of the host. the function returns the index of the
+ * last record it executed shifted left by two, ored with what the core must
+ * do next: run the following record, leave the block after this record or
+ * account a branch that ended the block. a page translated too many times
+ * is self-modifying and is left to the interpreter until the next reset. the
+ * implementation lives in cpu-dynarec.cc.
+ */
+
+#ifdef ENABLE_DYNAREC
+
+namespace cpu {
+
+class Dynarec
+{
+public: // public interface
+    Dynarec();
+
+    Dynarec(const Dynarec&) = delete;
+
+    Dynarec& operator=(const Dynarec&) = delete;
+
+    virtual ~Dynarec();
+
+    auto reset() -> void;
+
+    auto full() const -> bool;
+
+    auto translate(const uint8_t* page, const Decoded* code, uint32_t count, uint32_t& length) -> DynarecCode;
+
+    static constexpr uint32_t NEXT  = 0x000; /* run the following record */
+    static constexpr uint32_t LEAVE = 0x001; /* leave after the record   */
+    static constexpr uint32_t JUMP  = 0x002; /* a branch ended the block */
+    static constexpr uint32_t ABORT = 0x100; /* set by the thunks        */
+
+private: // private data
+    uint8_t* _buffer;
+    uint32_t _size;
+    uint32_t _used;
+    uint32_t _translations[256];
+};
+
+}
+
+#endif
+
+// ---------------------------------------------------------------------------
+// cpu::Block
+// ---------------------------------------------------------------------------
+
+namespace cpu {
+
+struct Block
+{
+    const uint8_t* page;       /* host page            */
+    uint32_t       generation; /* page generation      */
+    uint16_t       pc;         /* first instruction    */
+    uint16_t       count;      /* instruction count    */
+    uint32_t       code;       /* first decoded record */
+#ifdef ENABLE_DYNAREC
+    DynarecCode    native;     /* translated code      */
+    uint32_t       hits;       /* entries so far       */
+    uint32_t       length;     /* translated records   */
+#endif
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// cpu::Idle
+// ---------------------------------------------------------------------------
+
+namespace cpu {
+
+struct Idle
+{
+    Register r_af;     /* AF & AF'            */
+    Register r_bc;     /* BC & BC'            */
+    Register r_de;     /* DE & DE'            */
+    Register r_hl;     /* HL & HL'            */
+    Register r_ix;     /* IX Index            */
+    Register r_iy;     /* IY Index            */
+    Register r_sp;     /* Stack Pointer       */
+    Register r_st;     /* IFF, IM & Control   */
+    Register r_wz;     /* WZ Register         */
+    uint16_t r_pc;     /* Program Counter     */
+    uint8_t  r_i;      /* Interrupt Vector    */
+    uint8_t  r_r;      /* Memory Refresh      */
+    uint32_t m_cycles; /* M-Cycles            */
+    uint32_t t_states; /* T-States            */
+    bool     dirty;    /* written since taken */
+    bool     local;    /* taken by this run   */
+    bool     looping;  /* last pass unchanged */
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// cpu::Core<Bus>
 // ---------------------------------------------------------------------------
 
+/*
+ * the cpu core is parameterized on its bus. cpu::Instance binds it to the
+ * abstract cpu::Interface for embedders that need runtime polymorphism, any
+ * other bus providing the same cpu_mreq_xx/cpu_iorq_xx member functions (with
+ * a Core<Bus>& as first argument) gets its requests resolved at compile time.
+ * the implementation lives in cpu-core.inc.
+ */
+
 namespace cpu {
 
-class Instance
+template <typename Bus>
+class Core
 {
 public: // public interface
-    Instance(Interface&);
+    Core(Bus&);
 
-    Instance(const Instance&) = delete;
+    Core(const Core&) = delete;
 
-    Instance& operator=(const Instance&) = delete;
+    Core& operator=(const Core&) = delete;
 
-    virtual ~Instance() = default;
+    virtual ~Core() = default;
 
     auto reset() -> void;
 
     auto clock() -> void;
 
+    auto run(uint32_t budget) -> uint32_t;
+
+    auto cancel() -> void;
+
+    auto set_rd_pages(const uint8_t* const* pages) -> void;
+
+    auto flush() -> void;
+
+    auto flush(uint16_t addr, uint32_t size) -> void;
+
     auto pulse_nmi() -> void;
 
     auto pulse_int() -> void;
 
+    auto get_signals() const -> uint32_t;
+
+    auto set_signals(uint32_t signals) -> void;
+
+    auto idle() const -> bool;
+
     auto operator->() -> State*
     {
         return &_state;
     }
 
+protected: // protected interface
+#ifdef ENABLE_DYNAREC
+    static auto dynarec_rd(DynarecContext&, uint32_t addr) -> uint32_t;
+
+    static auto dynarec_wr(DynarecContext&, uint32_t addr, uint32_t data) -> uint32_t;
+#endif
+
 protected: // protected data
-    Interface& _interface;
-    State      _state;
+    Bus&                  _bus;
+    State                 _state;
+    uint32_t              _signals;
+    const uint8_t* const* _rd_pages;
+    Idle                  _idle;
+#ifdef ENABLE_BLOCK_CACHE
+    uint32_t              _generations[256];
+    uint64_t              _code_bits[256][4];
+    Block                 _blocks[4096];
+    Decoded               _decoded[8192];
+    uint32_t              _decoded_count;
+#endif
+#ifdef ENABLE_DYNAREC
+    Dynarec               _dynarec;
+#endif
 };
 
 }
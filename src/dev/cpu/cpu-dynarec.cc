@@ -0,0 +1,1141 @@
+/*
+ * cpu-dynarec.cc - Copyright (c) 2001-2026 - Olivier Poncet
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <cerrno>
+#include <cstdio>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cstdarg>
+#include <memory>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+#include "cpu-core.h"
+
+#ifdef ENABLE_DYNAREC
+
+#include <sys/mman.h>
+
+// ---------------------------------------------------------------------------
+// <anonymous>::constants
+// ---------------------------------------------------------------------------
+
+namespace {
+
+constexpr uint32_t DYNAREC_SIZE  = 4 * 1024 * 1024;                    /* size of the code arena          */
+constexpr uint32_t DYNAREC_INSN  = 256;                                /* room for the largest sequence   */
+constexpr uint32_t DYNAREC_LIMIT = 32;                                 /* records translated per block    */
+constexpr uint32_t DYNAREC_BLOCK = (DYNAREC_LIMIT + 1) * DYNAREC_INSN; /* room for the largest block      */
+constexpr uint32_t DYNAREC_SHORT = 4;                                  /* records worth the call at least */
+constexpr uint32_t DYNAREC_PAGE  = 64;                                 /* translations per page at most   */
+
+constexpr uint8_t SF = 0x80; /* Sign                   */
+constexpr uint8_t ZF = 0x40; /* Zero                   */
+constexpr uint8_t PF = 0x04; /* Parity                 */
+constexpr uint8_t CF = 0x01; /* Carry                  */
+
+constexpr uint8_t NIL = 0xff; /* not a register */
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::layout
+// ---------------------------------------------------------------------------
+
+/*
+ * the native code addresses the registers of the cpu::State through rbx, so
+ * every field below must be reachable with a signed 8-bit displacement.
+ */
+
+namespace {
+
+using cpu::State;
+using cpu::Register;
+using cpu::DynarecContext;
+
+constexpr uint8_t lo(const size_t offset)
+{
+    return offset + offsetof(Register, b.l);
+}
+
+constexpr uint8_t hi(const size_t offset)
+{
+    return offset + offsetof(Register, b.h);
+}
+
+constexpr uint8_t REG_F  = lo(offsetof(State, r_af));
+constexpr uint8_t REG_A  = hi(offsetof(State, r_af));
+constexpr uint8_t REG_C  = lo(offsetof(State, r_bc));
+constexpr uint8_t REG_B  = hi(offsetof(State, r_bc));
+constexpr uint8_t REG_E  = lo(offsetof(State, r_de));
+constexpr uint8_t REG_D  = hi(offsetof(State, r_de));
+constexpr uint8_t REG_L  = lo(offsetof(State, r_hl));
+constexpr uint8_t REG_H  = hi(offsetof(State, r_hl));
+constexpr uint8_t REG_AF = offsetof(State, r_af);
+constexpr uint8_t REG_BC = offsetof(State, r_bc);
+constexpr uint8_t REG_DE = offsetof(State, r_de);
+constexpr uint8_t REG_HL = offsetof(State, r_hl);
+constexpr uint8_t REG_SP = offsetof(State, r_sp);
+constexpr uint8_t REG_PC = offsetof(State, r_pc);
+constexpr uint8_t M_CYCLES = offsetof(State, m_cycles);
+constexpr uint8_t T_STATES = offsetof(State, t_states);
+constexpr uint8_t I_PERIOD = offsetof(State, i_period);
+
+constexpr uint8_t CTX_RD    = offsetof(DynarecContext, mreq_rd);
+constexpr uint8_t CTX_WR    = offsetof(DynarecContext, mreq_wr);
+constexpr uint8_t CTX_PAGES = offsetof(DynarecContext, pages);
+
+static_assert(I_PERIOD  < 0x80, "the state does not fit the displacements");
+static_assert(CTX_PAGES < 0x80, "the context does not fit the displacements");
+
+constexpr uint8_t REG08[8] = { /* by the 3-bit register field  */
+    REG_B, REG_C, REG_D, REG_E, REG_H, REG_L, NIL, REG_A
+};
+
+constexpr uint8_t REG16[4] = { /* bc, de, hl, sp               */
+    REG_BC, REG_DE, REG_HL, REG_SP
+};
+
+constexpr uint8_t STK16[4] = { /* bc, de, hl, af               */
+    REG_BC, REG_DE, REG_HL, REG_AF
+};
+
+constexpr uint8_t CONDITIONS[8] = { /* nz, z, nc, c, po, pe, p, m */
+    ZF, ZF, CF, CF, PF, PF, SF, SF
+};
+
+constexpr uint8_t X86_ALU[8] = { /* add, adc, sub, sbc, and, xor, or, cp */
+    0x00, 0x10, 0x28, 0x18, 0x20, 0x30, 0x08, 0x38
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::Emitter
+// ---------------------------------------------------------------------------
+
+/*
+ * the emitter only knows the handful of x86-64 encodings the translator
+ * needs. while a native function runs, rbx points to the cpu::State, r12 to
+ * the cpu::DynarecContext, r13 to the WZ register of the core, r14 holds a
+ * byte across the calls of the thunks and r15 ors together their results so
+ * a request to leave the block can be tested once per instruction.
+ */
+
+namespace {
+
+constexpr uint8_t EAX = 0;
+constexpr uint8_t ECX = 1;
+constexpr uint8_t EDX = 2;
+constexpr uint8_t ESI = 6;
+constexpr uint8_t AL  = 0;
+constexpr uint8_t CL  = 1;
+constexpr uint8_t AH  = 4;
+
+class Emitter
+{
+public: // public interface
+    Emitter(uint8_t* buffer)
+        : _buffer(buffer)
+        , _size(0)
+    {
+    }
+
+    auto size() const -> uint32_t
+    {
+        return _size;
+    }
+
+    auto emit(const std::initializer_list<uint8_t> bytes) -> void
+    {
+        for(const uint8_t byte : bytes) {
+            _buffer[_size++] = byte;
+        }
+    }
+
+    auto emit16(const uint32_t value) -> void
+    {
+        emit({ uint8_t(value), uint8_t(value >> 8) });
+    }
+
+    auto emit32(const uint32_t value) -> void
+    {
+        emit({ uint8_t(value), uint8_t(value >> 8), uint8_t(value >> 16), uint8_t(value >> 24) });
+    }
+
+    auto load08(const uint8_t reg, const uint8_t disp) -> void /* movzx reg, byte [rbx+disp] */
+    {
+        emit({ 0x0f, 0xb6, uint8_t(0x43 | (reg << 3)), disp });
+    }
+
+    auto load16(const uint8_t reg, const uint8_t disp) -> void /* movzx reg, word [rbx+disp] */
+    {
+        emit({ 0x0f, 0xb7, uint8_t(0x43 | (reg << 3)), disp });
+    }
+
+    auto store08(const uint8_t disp, const uint8_t reg) -> void /* mov byte [rbx+disp], reg */
+    {
+        emit({ 0x88, uint8_t(0x43 | (reg << 3)), disp });
+    }
+
+    auto store16(const uint8_t disp, const uint8_t reg) -> void /* mov word [rbx+disp], reg */
+    {
+        emit({ 0x66, 0x89, uint8_t(0x43 | (reg << 3)), disp });
+    }
+
+    auto store08_imm(const uint8_t disp, const uint32_t value) -> void /* mov byte [rbx+disp], imm */
+    {
+        emit({ 0xc6, 0x43, disp, uint8_t(value) });
+    }
+
+    auto store16_imm(const uint8_t disp, const uint32_t value) -> void /* mov word [rbx+disp], imm */
+    {
+        emit({ 0x66, 0xc7, 0x43, disp });
+        emit16(value);
+    }
+
+    auto inc16(const uint8_t disp) -> void /* inc word [rbx+disp] */
+    {
+        emit({ 0x66, 0xff, 0x43, disp });
+    }
+
+    auto dec16(const uint8_t disp) -> void /* dec word [rbx+disp] */
+    {
+        emit({ 0x66, 0xff, 0x4b, disp });
+    }
+
+    auto swap32(const uint8_t disp) -> void /* rol dword [rbx+disp], 16 */
+    {
+        emit({ 0xc1, 0x43, disp, 0x10 });
+    }
+
+    auto move_imm(const uint8_t reg, const uint32_t value) -> void /* mov reg, imm */
+    {
+        emit({ uint8_t(0xb8 | reg) });
+        emit32(value);
+    }
+
+    auto store_wz(const uint32_t value) -> void /* mov word [r13], imm */
+    {
+        emit({ 0x66, 0x41, 0xc7, 0x45, 0x00 });
+        emit16(value);
+    }
+
+    auto store_wz_ax() -> void /* mov word [r13], ax */
+    {
+        emit({ 0x66, 0x41, 0x89, 0x45, 0x00 });
+    }
+
+    auto consume(const uint32_t cycles, const uint32_t states) -> void /* add dword [rbx+disp], imm */
+    {
+        emit({ 0x83, 0x43, M_CYCLES, uint8_t(cycles) });
+        emit({ 0x83, 0x43, T_STATES, uint8_t(states) });
+        emit({ 0x83, 0x43, I_PERIOD, uint8_t(states) });
+    }
+
+    auto mreq_rd() -> void /* eax = byte at esi, read in place when its page is mapped */
+    {
+        emit({ 0x89, 0xf0 });                   /* mov eax, esi         */
+        emit({ 0xc1, 0xe8, 0x08 });             /* shr eax, 8           */
+        emit({ 0x49, 0x8b, 0x54, 0x24, CTX_PAGES }); /* mov rdx, [r12+pages] */
+        emit({ 0x48, 0x8b, 0x14, 0xc2 });       /* mov rdx, [rdx+rax*8] */
+        emit({ 0x48, 0x85, 0xd2 });             /* test rdx, rdx        */
+        emit({ 0x74, 0x0a });                   /* jz +10               */
+        emit({ 0x40, 0x0f, 0xb6, 0xce });       /* movzx ecx, sil       */
+        emit({ 0x0f, 0xb6, 0x04, 0x0a });       /* movzx eax, [rdx+rcx] */
+        emit({ 0xeb, 0x0b });                   /* jmp +11              */
+        emit({ 0x4c, 0x89, 0xe7 });             /* mov rdi, r12         */
+        emit({ 0x41, 0xff, 0x54, 0x24, CTX_RD });  /* call [r12+rd]     */
+        emit({ 0x41, 0x09, 0xc7 });             /* or r15d, eax         */
+    }
+
+    auto mreq_wr() -> void /* byte dl at esi */
+    {
+        emit({ 0x4c, 0x89, 0xe7 });             /* mov rdi, r12         */
+        emit({ 0x41, 0xff, 0x54, 0x24, CTX_WR });  /* call [r12+wr]     */
+        emit({ 0x41, 0x09, 0xc7 });             /* or r15d, eax         */
+    }
+
+    auto next_esi() -> void /* esi = (esi + 1) & 0xffff */
+    {
+        emit({ 0x8d, 0x76, 0x01 });             /* lea esi, [rsi+1]     */
+        emit({ 0x0f, 0xb7, 0xf6 });             /* movzx esi, si        */
+    }
+
+    auto call_helper(void (*helper)(State*)) -> void /* helper(rbx) */
+    {
+        const uint64_t address = reinterpret_cast<uintptr_t>(helper);
+        emit({ 0x48, 0x89, 0xdf });             /* mov rdi, rbx         */
+        emit({ 0x48, 0xb8 });                   /* mov rax, helper      */
+        emit32(address);
+        emit32(address >> 32);
+        emit({ 0xff, 0xd0 });                   /* call rax             */
+    }
+
+    auto clear_abort() -> void /* xor r15d, r15d */
+    {
+        emit({ 0x45, 0x31, 0xff });
+    }
+
+    auto test_abort(const uint32_t status, const uint32_t epilogue) -> void
+    {
+        emit({ 0x41, 0xf7, 0xc7 });             /* test r15d, abort     */
+        emit32(cpu::Dynarec::ABORT);
+        emit({ 0x74, 0x0a });                   /* jz +10               */
+        leave(status, epilogue);
+    }
+
+    auto leave(const uint32_t status, const uint32_t epilogue) -> void
+    {
+        move_imm(EAX, status);                  /* mov eax, status      */
+        emit({ 0xe9 });                         /* jmp epilogue         */
+        emit32(epilogue - (_size + 4));
+    }
+
+    auto skip_unless(const uint8_t condition) -> uint32_t /* test byte [rbx+F], mask ; jcc rel32 */
+    {
+        emit({ 0xf6, 0x43, REG_F, CONDITIONS[condition] });
+        emit({ 0x0f, uint8_t((condition & 1) != 0 ? 0x84 : 0x85) });
+        emit32(0);
+        return _size;
+    }
+
+    auto skip_unless_nonzero() -> uint32_t /* jz rel32 */
+    {
+        emit({ 0x0f, 0x84 });
+        emit32(0);
+        return _size;
+    }
+
+    auto resolve(const uint32_t label) -> void
+    {
+        const uint32_t offset = _size - label;
+        _buffer[label - 4] = offset;
+        _buffer[label - 3] = offset >> 8;
+        _buffer[label - 2] = offset >> 16;
+        _buffer[label - 1] = offset >> 24;
+    }
+
+private: // private data
+    uint8_t* _buffer;
+    uint32_t _size;
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::helpers
+// ---------------------------------------------------------------------------
+
+/*
+ * the instructions that are not worth their own sequence are run by a plain
+ * function called from the native code, with the same formulas as the
+ * microcode.
+ */
+
+namespace {
+
+auto dynarec_daa(State* state) -> void
+{
+    const uint8_t r1 = state->r_af.b.h;
+    uint8_t       f  = state->r_af.b.l;
+    uint8_t       r2 = 0x00;
+
+    if(((f & 0x10) != 0) || ((r1 & 0x0f) > 0x09)) {
+        r2 |= 0x06;
+    }
+    if(((f & CF) != 0) || (r1 > 0x99)) {
+        r2 |= 0x60;
+        f  |= CF;
+    }
+    const uint8_t r0 = ((f & 0x02) == 0 ? r1 + r2 : r1 - r2);
+    state->r_af.b.h = r0;
+    state->r_af.b.l = /* SF is affected     */ (SF   & (r0))
+                    | /* ZF is affected     */ (ZF   & (r0 == 0 ? 0xff : 0x00))
+                    | /* YF is undocumented */ (0x20 & (r0))
+                    | /* HF is affected     */ (0x10 & (r0 ^ r1 ^ r2))
+                    | /* XF is undocumented */ (0x08 & (r0))
+                    | /* PF is affected     */ (PF   & (__builtin_parity(r0) == 0 ? 0xff : 0x00))
+                    | /* NF is not affected */ (0x02 & (f))
+                    | /* CF is affected     */ (CF   & (f))
+                    ;
+}
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::liveness
+// ---------------------------------------------------------------------------
+
+/*
+ * the interpreter builds F lazily, so the translation must not build it for
+ * every instruction either. the liveness of F is tracked in two parts, the
+ * carry and the other flags, because inc/dec redefine all of F but the carry.
+ * a record that leaves the native code, reads F or is not handled below uses
+ * both parts.
+ */
+
+namespace {
+
+constexpr uint8_t LIVE_CF   = 0x01; /* the carry is observed       */
+constexpr uint8_t LIVE_REST = 0x02; /* the other flags are observed */
+constexpr uint8_t LIVE_ALL  = LIVE_CF | LIVE_REST;
+
+struct Usage
+{
+    uint8_t kill; /* parts redefined by the record */
+    uint8_t use;  /* parts read by the record      */
+};
+
+auto flags_usage(const uint8_t opcode) -> Usage
+{
+    const uint8_t dst = REG08[(opcode >> 3) & 7];
+    const uint8_t src = REG08[(opcode >> 0) & 7];
+    const uint8_t op  = ((opcode >> 3) & 7);
+
+    if(((opcode & 0xc0) == 0x40) && (dst != NIL) && (src != NIL)) {
+        return Usage{ 0x00, 0x00 };            /* ld r,r'              */
+    }
+    if((((opcode & 0xc0) == 0x80) && (src != NIL)) || ((opcode & 0xc7) == 0xc6)) {
+        if((op == 1) || (op == 3)) {
+            return Usage{ LIVE_ALL, LIVE_CF }; /* adc/sbc a,r/n        */
+        }
+        return Usage{ LIVE_ALL, 0x00 };        /* alu a,r/n            */
+    }
+    if(((opcode & 0xc7) == 0x06) && (dst != NIL)) {
+        return Usage{ 0x00, 0x00 };            /* ld r,n               */
+    }
+    if(((opcode & 0xc6) == 0x04) && (dst != NIL)) {
+        return Usage{ LIVE_REST, 0x00 };       /* inc/dec r            */
+    }
+    switch(opcode & 0xcf) {
+        case 0x01: /* ld rr,nn */
+        case 0x03: /* inc rr   */
+        case 0x0b: /* dec rr   */
+            return Usage{ 0x00, 0x00 };
+        default:
+            break;
+    }
+    switch(opcode) {
+        case 0x00: /* nop      */
+        case 0xd9: /* exx      */
+        case 0xeb: /* ex de,hl */
+        case 0xf9: /* ld sp,hl */
+            return Usage{ 0x00, 0x00 };
+        default:
+            break;
+    }
+    return Usage{ 0x00, LIVE_ALL };
+}
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::Translator
+// ---------------------------------------------------------------------------
+
+/*
+ * each sequence below mirrors the threaded handler of the same opcode in
+ * cpu-blocks.inc: same bus requests in the same order, same WZ and same
+ * flags. the flags are taken from the host ones (sahf layout SZ0A0P1C,
+ * overflow with seto) and completed with the undocumented bits 5 and 3.
+ */
+
+namespace {
+
+class Translator
+{
+public: // public interface
+    Translator(Emitter& emitter, const uint32_t epilogue)
+        : _emitter(emitter)
+        , _epilogue(epilogue)
+    {
+    }
+
+    auto translate(const uint8_t opcode, const cpu::Decoded& record, const uint32_t index, const uint8_t live, bool& jump) -> bool;
+
+private: // private interface
+    auto flags(const uint8_t mask, const bool result, const bool overflow, const uint8_t extra) -> void;
+
+    auto alu(const uint8_t operation, const bool live) -> void;
+
+    auto inc_dec(const bool dec, const bool live) -> void;
+
+    auto read(const uint8_t reg16) -> void;
+
+    auto write(const uint8_t reg16) -> void;
+
+    auto push_imm(const uint32_t value) -> void;
+
+    auto pop_wz() -> void;
+
+private: // private data
+    Emitter&       _emitter;
+    const uint32_t _epilogue;
+};
+
+/*
+ * builds F from ah (lahf) and dl (seto): the host flags kept by the mask,
+ * the bits 5 and 3 of al or cl, the overflow in bit 2 and the extra bits.
+ */
+
+auto Translator::flags(const uint8_t mask, const bool result, const bool overflow, const uint8_t extra) -> void
+{
+    Emitter& e(_emitter);
+
+    if(mask != 0xff) {
+        e.emit({ 0x80, 0xe4, mask });          /* and ah, mask         */
+    }
+    if(result) {
+        e.emit({ 0x88, 0xc1 });                /* mov cl, al           */
+    }
+    e.emit({ 0x80, 0xe1, 0x28 });              /* and cl, 0x28         */
+    e.emit({ 0x08, 0xcc });                    /* or ah, cl            */
+    if(overflow) {
+        e.emit({ 0xc0, 0xe2, 0x02 });          /* shl dl, 2            */
+        e.emit({ 0x08, 0xd4 });                /* or ah, dl            */
+    }
+    if(extra != 0) {
+        e.emit({ 0x80, 0xcc, extra });         /* or ah, extra         */
+    }
+    e.store08(REG_F, AH);
+}
+
+/*
+ * alu a,cl, F is left alone when nothing can observe it
+ */
+
+auto Translator::alu(const uint8_t operation, const bool live) -> void
+{
+    Emitter& e(_emitter);
+
+    if((live == false) && (operation == 7)) {
+        return;
+    }
+    e.load08(EAX, REG_A);
+    if((operation == 1) || (operation == 3)) {
+        e.load08(EDX, REG_F);
+        e.emit({ 0xd0, 0xea });                /* shr dl, 1            */
+    }
+    e.emit({ X86_ALU[operation], 0xc8 });      /* op al, cl            */
+    if(live == false) {
+        e.store08(REG_A, AL);
+        return;
+    }
+    e.emit({ 0x9f });                          /* lahf                 */
+    if(operation != 7) {
+        e.store08(REG_A, AL);
+    }
+    switch(operation) {
+        case 0: /* add */
+        case 1: /* adc */
+            e.emit({ 0x0f, 0x90, 0xc2 });      /* seto dl              */
+            flags(0xd1, true, true, 0x00);
+            break;
+        case 2: /* sub */
+        case 3: /* sbc */
+            e.emit({ 0x0f, 0x90, 0xc2 });      /* seto dl              */
+            flags(0xd1, true, true, 0x02);
+            break;
+        case 4: /* and */
+            flags(0xc4, true, false, 0x10);
+            break;
+        case 5: /* xor */
+        case 6: /* or  */
+            flags(0xc4, true, false, 0x00);
+            break;
+        default: /* cp */
+            e.emit({ 0x0f, 0x90, 0xc2 });      /* seto dl              */
+            flags(0xd1, false, true, 0x02);
+            break;
+    }
+}
+
+/*
+ * inc/dec al, F is left alone when nothing can observe it
+ */
+
+auto Translator::inc_dec(const bool dec, const bool live) -> void
+{
+    Emitter& e(_emitter);
+
+    e.emit({ 0xfe, uint8_t(dec ? 0xc8 : 0xc0) }); /* inc/dec al        */
+    if(live == false) {
+        return;
+    }
+    e.emit({ 0x9f });                          /* lahf                 */
+    e.emit({ 0x0f, 0x90, 0xc2 });              /* seto dl              */
+    e.load08(ECX, REG_F);
+    e.emit({ 0x80, 0xe1, CF });                /* and cl, CF           */
+    e.emit({ 0x80, 0xe4, 0xd0 });              /* and ah, 0xd0         */
+    e.emit({ 0x08, 0xcc });                    /* or ah, cl            */
+    flags(0xff, true, true, uint8_t(dec ? 0x02 : 0x00));
+}
+
+/*
+ * al = mreq_rd(reg16)
+ */
+
+auto Translator::read(const uint8_t reg16) -> void
+{
+    _emitter.load16(ESI, reg16);
+    _emitter.mreq_rd();
+}
+
+/*
+ * mreq_wr(reg16, dl)
+ */
+
+auto Translator::write(const uint8_t reg16) -> void
+{
+    _emitter.load16(ESI, reg16);
+    _emitter.mreq_wr();
+}
+
+/*
+ * push imm16
+ */
+
+auto Translator::push_imm(const uint32_t value) -> void
+{
+    Emitter& e(_emitter);
+
+    e.dec16(REG_SP);
+    e.move_imm(EDX, (value >> 8) & 0xff);
+    write(REG_SP);
+    e.dec16(REG_SP);
+    e.move_imm(EDX, (value >> 0) & 0xff);
+    write(REG_SP);
+}
+
+/*
+ * wz = pop, pc = wz
+ */
+
+auto Translator::pop_wz() -> void
+{
+    Emitter& e(_emitter);
+
+    read(REG_SP);
+    e.inc16(REG_SP);
+    e.emit({ 0x41, 0x89, 0xc6 });              /* mov r14d, eax        */
+    read(REG_SP);
+    e.inc16(REG_SP);
+    e.emit({ 0xc1, 0xe0, 0x08 });              /* shl eax, 8           */
+    e.emit({ 0x44, 0x88, 0xf0 });              /* mov al, r14b         */
+    e.store_wz_ax();
+    e.store16(REG_PC, EAX);
+}
+
+auto Translator::translate(const uint8_t opcode, const cpu::Decoded& record, const uint32_t index, const uint8_t live, bool& jump) -> bool
+{
+    Emitter&       e(_emitter);
+    const uint32_t leave   = (index << 2) | cpu::Dynarec::LEAVE;
+    const uint32_t operand = record.operand;
+    const uint32_t next    = record.next;
+    const uint8_t  dst     = REG08[(opcode >> 3) & 7];
+    const uint8_t  src     = REG08[(opcode >> 0) & 7];
+
+    /* 8-bit load group */
+    if(((opcode & 0xc0) == 0x40) && (opcode != 0x76)) {
+        if((dst != NIL) && (src != NIL)) {     /* ld r,r'              */
+            if(dst != src) {
+                e.load08(EAX, src);
+                e.store08(dst, AL);
+            }
+        }
+        else if(dst != NIL) {                  /* ld r,(hl)            */
+            e.clear_abort();
+            read(REG_HL);
+            e.store08(dst, AL);
+            e.test_abort(leave, _epilogue);
+        }
+        else {                                 /* ld (hl),r            */
+            e.clear_abort();
+            e.load08(EDX, src);
+            write(REG_HL);
+            e.test_abort(leave, _epilogue);
+        }
+        return true;
+    }
+    /* 8-bit arithmetic and logical group */
+    if((opcode & 0xc0) == 0x80) {
+        if(src != NIL) {                       /* alu a,r              */
+            e.load08(ECX, src);
+            alu((opcode >> 3) & 7, live != 0);
+        }
+        else {                                 /* alu a,(hl)           */
+            e.clear_abort();
+            read(REG_HL);
+            e.emit({ 0x88, 0xc1 });            /* mov cl, al           */
+            alu((opcode >> 3) & 7, true);
+            e.test_abort(leave, _epilogue);
+        }
+        return true;
+    }
+    if((opcode & 0xc7) == 0xc6) {              /* alu a,n              */
+        e.emit({ 0xb1, uint8_t(operand) });    /* mov cl, n            */
+        alu((opcode >> 3) & 7, live != 0);
+        return true;
+    }
+    if((opcode & 0xc7) == 0x06) {
+        if(dst != NIL) {                       /* ld r,n               */
+            e.store08_imm(dst, operand);
+        }
+        else {                                 /* ld (hl),n            */
+            e.clear_abort();
+            e.move_imm(EDX, operand & 0xff);
+            write(REG_HL);
+            e.test_abort(leave, _epilogue);
+        }
+        return true;
+    }
+    if((opcode & 0xc6) == 0x04) {
+        const bool dec = ((opcode & 1) != 0);
+        if(dst != NIL) {                       /* inc/dec r            */
+            e.load08(EAX, dst);
+            inc_dec(dec, (live & LIVE_REST) != 0);
+            e.store08(dst, AL);
+        }
+        else {                                 /* inc/dec (hl)         */
+            e.clear_abort();
+            read(REG_HL);
+            inc_dec(dec, true);
+            e.emit({ 0x0f, 0xb6, 0xd0 });      /* movzx edx, al        */
+            write(REG_HL);
+            e.test_abort(leave, _epilogue);
+        }
+        return true;
+    }
+    /* 16-bit load and arithmetic groups */
+    switch(opcode & 0xcf) {
+        case 0x01: /* ld rr,nn */
+            e.store16_imm(REG16[(opcode >> 4) & 3], operand);
+            return true;
+        case 0x03: /* inc rr   */
+            e.inc16(REG16[(opcode >> 4) & 3]);
+            return true;
+        case 0x0b: /* dec rr   */
+            e.dec16(REG16[(opcode >> 4) & 3]);
+            return true;
+        case 0x09: /* add hl,rr */
+            e.load16(EAX, REG_HL);
+            e.load16(ECX, REG16[(opcode >> 4) & 3]);
+            e.emit({ 0x89, 0xc2 });            /* mov edx, eax         */
+            e.emit({ 0x01, 0xc8 });            /* add eax, ecx         */
+            e.store16(REG_HL, EAX);
+            e.emit({ 0x31, 0xca });            /* xor edx, ecx         */
+            e.emit({ 0x31, 0xc2 });            /* xor edx, eax         */
+            e.emit({ 0xc1, 0xea, 0x08 });      /* shr edx, 8           */
+            e.emit({ 0x83, 0xe2, 0x10 });      /* and edx, HF          */
+            e.emit({ 0x89, 0xc1 });            /* mov ecx, eax         */
+            e.emit({ 0xc1, 0xe9, 0x10 });      /* shr ecx, 16          */
+            e.emit({ 0x09, 0xca });            /* or edx, ecx          */
+            e.emit({ 0xc1, 0xe8, 0x08 });      /* shr eax, 8           */
+            e.emit({ 0x83, 0xe0, 0x28 });      /* and eax, YF|XF       */
+            e.emit({ 0x09, 0xc2 });            /* or edx, eax          */
+            e.load08(EAX, REG_F);
+            e.emit({ 0x83, 0xe0, 0xc4 });      /* and eax, SF|ZF|PF    */
+            e.emit({ 0x09, 0xd0 });            /* or eax, edx          */
+            e.store08(REG_F, AL);
+            return true;
+        case 0xc1: /* pop rr    */
+            e.clear_abort();
+            read(REG_SP);
+            e.inc16(REG_SP);
+            e.emit({ 0x41, 0x89, 0xc6 });      /* mov r14d, eax        */
+            read(REG_SP);
+            e.inc16(REG_SP);
+            e.emit({ 0xc1, 0xe0, 0x08 });      /* shl eax, 8           */
+            e.emit({ 0x44, 0x88, 0xf0 });      /* mov al, r14b         */
+            e.store16(STK16[(opcode >> 4) & 3], EAX);
+            e.test_abort(leave, _epilogue);
+            return true;
+        case 0xc5: /* push rr   */
+            e.clear_abort();
+            e.load16(EAX, STK16[(opcode >> 4) & 3]);
+            e.emit({ 0x41, 0x89, 0xc6 });      /* mov r14d, eax        */
+            e.dec16(REG_SP);
+            e.emit({ 0x44, 0x89, 0xf2 });      /* mov edx, r14d        */
+            e.emit({ 0xc1, 0xea, 0x08 });      /* shr edx, 8           */
+            write(REG_SP);
+            e.dec16(REG_SP);
+            e.emit({ 0x41, 0x0f, 0xb6, 0xd6 }); /* movzx edx, r14b     */
+            write(REG_SP);
+            e.test_abort(leave, _epilogue);
+            return true;
+        default:
+            break;
+    }
+    switch(opcode) {
+        case 0x00: /* nop        */
+            return true;
+        case 0x02: /* ld (bc),a  */
+        case 0x12: /* ld (de),a  */
+            e.clear_abort();
+            e.load08(EDX, REG_A);
+            write(opcode == 0x02 ? REG_BC : REG_DE);
+            e.test_abort(leave, _epilogue);
+            return true;
+        case 0x0a: /* ld a,(bc)  */
+        case 0x1a: /* ld a,(de)  */
+            e.clear_abort();
+            read(opcode == 0x0a ? REG_BC : REG_DE);
+            e.store08(REG_A, AL);
+            e.test_abort(leave, _epilogue);
+            return true;
+        case 0x22: /* ld (nn),hl */
+            e.clear_abort();
+            e.load08(EDX, REG_L);
+            e.move_imm(ESI, operand);
+            e.mreq_wr();
+            e.load08(EDX, REG_H);
+            e.move_imm(ESI, (operand + 1) & 0xffff);
+            e.mreq_wr();
+            e.store_wz((operand + 2) & 0xffff);
+            e.test_abort(leave, _epilogue);
+            return true;
+        case 0x2a: /* ld hl,(nn) */
+            e.clear_abort();
+            e.move_imm(ESI, operand);
+            e.mreq_rd();
+            e.store08(REG_L, AL);
+            e.move_imm(ESI, (operand + 1) & 0xffff);
+            e.mreq_rd();
+            e.store08(REG_H, AL);
+            e.store_wz((operand + 2) & 0xffff);
+            e.test_abort(leave, _epilogue);
+            return true;
+        case 0x32: /* ld (nn),a  */
+            e.clear_abort();
+            e.store_wz(operand);
+            e.load08(EDX, REG_A);
+            e.move_imm(ESI, operand);
+            e.mreq_wr();
+            e.test_abort(leave, _epilogue);
+            return true;
+        case 0x3a: /* ld a,(nn)  */
+            e.clear_abort();
+            e.store_wz(operand);
+            e.move_imm(ESI, operand);
+            e.mreq_rd();
+            e.store08(REG_A, AL);
+            e.test_abort(leave, _epilogue);
+            return true;
+        case 0x07: /* rlca       */
+        case 0x0f: /* rrca       */
+        case 0x17: /* rla        */
+        case 0x1f: /* rra        */
+            e.load08(EAX, REG_A);
+            e.load08(ECX, REG_F);
+            e.emit({ 0xd0, 0xe9 });            /* shr cl, 1            */
+            e.emit({ 0xd0, uint8_t(0xc0 | ((opcode >> 3) & 3) << 3) }); /* rol/ror/rcl/rcr al, 1 */
+            e.emit({ 0x0f, 0x92, 0xc2 });      /* setc dl              */
+            e.store08(REG_A, AL);
+            e.load08(ECX, REG_F);
+            e.emit({ 0x80, 0xe1, 0xc4 });      /* and cl, SF|ZF|PF     */
+            e.emit({ 0x24, 0x28 });            /* and al, YF|XF        */
+            e.emit({ 0x08, 0xc8 });            /* or al, cl            */
+            e.emit({ 0x08, 0xd0 });            /* or al, dl            */
+            e.store08(REG_F, AL);
+            return true;
+        case 0x2f: /* cpl        */
+        case 0x37: /* scf        */
+        case 0x3f: /* ccf        */
+            e.load08(EAX, REG_A);
+            e.load08(ECX, REG_F);
+            if(opcode == 0x2f) {
+                e.emit({ 0xf6, 0xd0 });        /* not al               */
+                e.store08(REG_A, AL);
+                e.emit({ 0x80, 0xe1, 0xc5 });  /* and cl, SF|ZF|PF|CF  */
+                e.emit({ 0x80, 0xc9, 0x12 });  /* or cl, HF|NF         */
+            }
+            else if(opcode == 0x37) {
+                e.emit({ 0x80, 0xe1, 0xc4 });  /* and cl, SF|ZF|PF     */
+                e.emit({ 0x80, 0xc9, 0x01 });  /* or cl, CF            */
+            }
+            else {
+                e.emit({ 0x88, 0xca });        /* mov dl, cl           */
+                e.emit({ 0x80, 0xe2, 0x01 });  /* and dl, CF           */
+                e.emit({ 0xc0, 0xe2, 0x04 });  /* shl dl, 4            */
+                e.emit({ 0x80, 0xe1, 0xc5 });  /* and cl, SF|ZF|PF|CF  */
+                e.emit({ 0x80, 0xf1, 0x01 });  /* xor cl, CF           */
+                e.emit({ 0x08, 0xd1 });        /* or cl, dl            */
+            }
+            e.emit({ 0x24, 0x28 });            /* and al, YF|XF        */
+            e.emit({ 0x08, 0xc1 });            /* or cl, al            */
+            e.store08(REG_F, CL);
+            return true;
+        case 0x27: /* daa        */
+            e.call_helper(&dynarec_daa);
+            return true;
+        case 0xe3: /* ex (sp),hl */
+            e.clear_abort();
+            read(REG_SP);
+            e.emit({ 0x44, 0x0f, 0xb6, 0xf0 }); /* movzx r14d, al      */
+            e.load16(ESI, REG_SP);
+            e.next_esi();
+            e.mreq_rd();
+            e.emit({ 0x0f, 0xb6, 0xc0 });      /* movzx eax, al        */
+            e.emit({ 0xc1, 0xe0, 0x08 });      /* shl eax, 8           */
+            e.emit({ 0x41, 0x09, 0xc6 });      /* or r14d, eax         */
+            e.load08(EDX, REG_L);
+            write(REG_SP);
+            e.load08(EDX, REG_H);
+            e.load16(ESI, REG_SP);
+            e.next_esi();
+            e.mreq_wr();
+            e.emit({ 0x66, 0x44, 0x89, 0x73, REG_HL }); /* mov [rbx+HL], r14w */
+            e.test_abort(leave, _epilogue);
+            return true;
+        case 0x08: /* ex af,af'  */
+            e.swap32(REG_AF);
+            return true;
+        case 0xd9: /* exx        */
+            e.swap32(REG_BC);
+            e.swap32(REG_DE);
+            e.swap32(REG_HL);
+            return true;
+        case 0xeb: /* ex de,hl   */
+            e.load16(EAX, REG_DE);
+            e.load16(ECX, REG_HL);
+            e.store16(REG_DE, ECX);
+            e.store16(REG_HL, EAX);
+            return true;
+        case 0xf9: /* ld sp,hl   */
+            e.load16(EAX, REG_HL);
+            e.store16(REG_SP, EAX);
+            return true;
+        default:
+            break;
+    }
+    /* jump, call and return groups, they end the block */
+    jump = true;
+    switch(opcode & 0xc7) {
+        case 0xc2: /* jp cc,nn   */
+            {
+                e.store_wz(next);
+                e.store16_imm(REG_PC, next);
+                const uint32_t label = e.skip_unless((opcode >> 3) & 7);
+                e.store_wz(operand);
+                e.store16_imm(REG_PC, operand);
+                e.resolve(label);
+            }
+            return true;
+        case 0xc4: /* call cc,nn */
+            {
+                e.store_wz(next);
+                e.store16_imm(REG_PC, next);
+                const uint32_t label = e.skip_unless((opcode >> 3) & 7);
+                e.store_wz(operand);
+                push_imm(next);
+                e.store16_imm(REG_PC, operand);
+                e.consume(2, 7);
+                e.resolve(label);
+            }
+            return true;
+        case 0xc0: /* ret cc     */
+            {
+                e.store16_imm(REG_PC, next);
+                const uint32_t label = e.skip_unless((opcode >> 3) & 7);
+                pop_wz();
+                e.consume(2, 6);
+                e.resolve(label);
+            }
+            return true;
+        case 0xc7: /* rst p      */
+            e.store16_imm(REG_PC, next);
+            push_imm(next);
+            e.store_wz(opcode & 0x38);
+            e.store16_imm(REG_PC, opcode & 0x38);
+            return true;
+        default:
+            break;
+    }
+    switch(opcode) {
+        case 0xc3: /* jp nn      */
+        case 0x18: /* jr d       */
+            e.store_wz(operand);
+            e.store16_imm(REG_PC, operand);
+            return true;
+        case 0x20: /* jr nz,d    */
+        case 0x28: /* jr z,d     */
+        case 0x30: /* jr nc,d    */
+        case 0x38: /* jr c,d     */
+            {
+                e.store16_imm(REG_PC, next);
+                const uint32_t label = e.skip_unless((opcode >> 3) & 3);
+                e.store_wz(operand);
+                e.store16_imm(REG_PC, operand);
+                e.consume(1, 5);
+                e.resolve(label);
+            }
+            return true;
+        case 0x10: /* djnz d     */
+            {
+                e.store16_imm(REG_PC, next);
+                e.emit({ 0xfe, 0x4b, REG_B }); /* dec byte [rbx+B]     */
+                const uint32_t label = e.skip_unless_nonzero();
+                e.store_wz(operand);
+                e.store16_imm(REG_PC, operand);
+                e.consume(1, 5);
+                e.resolve(label);
+            }
+            return true;
+        case 0xcd: /* call nn    */
+            e.store_wz(operand);
+            push_imm(next);
+            e.store16_imm(REG_PC, operand);
+            return true;
+        case 0xc9: /* ret        */
+            pop_wz();
+            return true;
+        case 0xe9: /* jp (hl)    */
+            e.load16(EAX, REG_HL);
+            e.store16(REG_PC, EAX);
+            return true;
+        default:
+            break;
+    }
+    jump = false;
+    return false;
+}
+
+}
+
+// ---------------------------------------------------------------------------
+// cpu::Dynarec
+// ---------------------------------------------------------------------------
+
+namespace cpu {
+
+Dynarec::Dynarec()
+    : _buffer(nullptr)
+    , _size(0)
+    , _used(0)
+    , _translations()
+{
+    void* buffer = ::mmap(nullptr, DYNAREC_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(buffer != MAP_FAILED) {
+        _buffer = static_cast<uint8_t*>(buffer);
+        _size   = DYNAREC_SIZE;
+    }
+}
+
+Dynarec::~Dynarec()
+{
+    if(_buffer != nullptr) {
+        static_cast<void>(::munmap(_buffer, _size));
+        _buffer = nullptr;
+    }
+}
+
+auto Dynarec::reset() -> void
+{
+    _used = 0;
+    for(auto& translations : _translations) {
+        translations = 0;
+    }
+}
+
+auto Dynarec::full() const -> bool
+{
+    return (_used + DYNAREC_BLOCK) > _size;
+}
+
+/*
+ * the function starts with its epilogue, so every exit is a backward jump
+ * to it, then saves the callee-saved registers it uses (five pushes keep the
+ * stack aligned for the calls to the thunks) and translates the records
+ * until the first one it does not know or the branch that ends the block.
+ * a translation shorter than DYNAREC_SHORT records does not pay for the call
+ * and is dropped, as are the pages rewritten so often that their blocks keep
+ * being translated again.
+ */
+
+auto Dynarec::translate(const uint8_t* page, const Decoded* code, const uint32_t count, uint32_t& length) -> DynarecCode
+{
+    length = 0;
+    if((_buffer == nullptr) || (count == 0) || ((_used + DYNAREC_BLOCK) > _size)) {
+        return nullptr;
+    }
+    if(++_translations[(code->pc >> 8) & 0xff] > DYNAREC_PAGE) {
+        return nullptr;
+    }
+    uint8_t* const buffer = _buffer + _used;
+    Emitter        emitter(buffer);
+    bool           jump = false;
+
+    emitter.emit({ 0x41, 0x5f });              /* pop r15              */
+    emitter.emit({ 0x41, 0x5e });              /* pop r14              */
+    emitter.emit({ 0x41, 0x5d });              /* pop r13              */
+    emitter.emit({ 0x41, 0x5c });              /* pop r12              */
+    emitter.emit({ 0x5b });                    /* pop rbx              */
+    emitter.emit({ 0xc3 });                    /* ret                  */
+    const uint32_t entry = emitter.size();
+    emitter.emit({ 0x53 });                    /* push rbx             */
+    emitter.emit({ 0x41, 0x54 });              /* push r12             */
+    emitter.emit({ 0x41, 0x55 });              /* push r13             */
+    emitter.emit({ 0x41, 0x56 });              /* push r14             */
+    emitter.emit({ 0x41, 0x57 });              /* push r15             */
+    emitter.emit({ 0x48, 0x89, 0xfb });        /* mov rbx, rdi         */
+    emitter.emit({ 0x49, 0x89, 0xf5 });        /* mov r13, rsi         */
+    emitter.emit({ 0x49, 0x89, 0xd4 });        /* mov r12, rdx         */
+
+    const uint32_t limit = (count < DYNAREC_LIMIT ? count : DYNAREC_LIMIT);
+    uint8_t        live[DYNAREC_LIMIT];
+    live[limit - 1] = LIVE_ALL;
+    for(uint32_t index = limit - 1; index != 0; --index) {
+        const Usage usage(flags_usage(page[code[index].pc & 0xff]));
+        live[index - 1] = (live[index] & ~usage.kill) | usage.use;
+    }
+
+    Translator translator(emitter, 0);
+    while((length < limit) && (jump == false)) {
+        const Decoded& record(code[length]);
+        if(translator.translate(page[record.pc & 0xff], record, length, live[length], jump) == false) {
+            break;
+        }
+        ++length;
+    }
+    if(length < DYNAREC_SHORT) {
+        length = 0;
+        return nullptr;
+    }
+    if(jump != false) {
+        emitter.leave(((length - 1) << 2) | JUMP, 0);
+    }
+    else {
+        emitter.leave(((length - 1) << 2) | NEXT, 0);
+    }
+    _used += (emitter.size() + 15) & ~15;
+
+    return reinterpret_cast<DynarecCode>(buffer + entry);
+}
+
+}
+
+#endif
+
+// ---------------------------------------------------------------------------
+// End-Of-File
+// ---------------------------------------------------------------------------
@@ -28,6 +28,9 @@
 #include <vector>
 #include <iostream>
 #include <stdexcept>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "mmu-core.h"
 
 // ---------------------------------------------------------------------------
@@ -50,6 +53,69 @@ constexpr uint16_t MMU_OCHR_ADDR = 0xffff; /* output character */
 
 }
 
+// ---------------------------------------------------------------------------
+// <anonymous>::mmu_paging
+// ---------------------------------------------------------------------------
+
+namespace {
+
+constexpr uint16_t MMU_PAGE_PORT = 0x0078; /* page registers (0x78-0x7b) */
+constexpr uint16_t MMU_PAGE_ENBL = 0x007c; /* paging enable              */
+constexpr uint8_t  MMU_PAGE_MASK = 0x3f;   /* physical page mask         */
+constexpr uint8_t  MMU_ROM_PAGES = 32;     /* rom pages (512kB)          */
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::mmu_memory
+// ---------------------------------------------------------------------------
+
+/*
+ * the state lives in its own anonymous private mapping, so the banks are
+ * page-aligned and can be replaced in place by a private mapping of their
+ * image file. the pages of an image are then shared with the page cache and
+ * with every other vm using it, and only the pages written to get copied.
+ */
+
+namespace {
+
+auto allocate_state() -> mmu::State&
+{
+#ifndef __EMSCRIPTEN__
+    void* state = ::mmap(nullptr, sizeof(mmu::State), (PROT_READ | PROT_WRITE), (MAP_PRIVATE | MAP_ANONYMOUS), -1, 0);
+    if(state == MAP_FAILED) {
+        throw std::runtime_error("mmap() has failed");
+    }
+    return *static_cast<mmu::State*>(state);
+#else
+    return *(new mmu::State());
+#endif
+}
+
+auto release_state(mmu::State& state) -> void
+{
+#ifndef __EMSCRIPTEN__
+    static_cast<void>(::munmap(&state, sizeof(mmu::State)));
+#else
+    delete &state;
+#endif
+}
+
+auto discard_state(mmu::State& state) -> bool
+{
+#ifndef __EMSCRIPTEN__
+    void* result = ::mmap(&state, sizeof(mmu::State), (PROT_READ | PROT_WRITE), (MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED), -1, 0);
+    if(result == MAP_FAILED) {
+        throw std::runtime_error("mmap() has failed");
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+}
+
 // ---------------------------------------------------------------------------
 // mmu::BankReader
 // ---------------------------------------------------------------------------
@@ -76,6 +142,50 @@ public: // public interface
     }
 
     auto load(Bank& bank) -> void
+    {
+        if(map(bank) == false) {
+            read(bank);
+        }
+    }
+
+    auto banks() -> size_t
+    {
+        struct stat status;
+        if((::fstat(::fileno(_stream), &status) == 0) && (S_ISREG(status.st_mode) != 0)) {
+            return status.st_size / sizeof(Bank::data);
+        }
+        return 1;
+    }
+
+private: // private interface
+    auto map(Bank& bank) -> bool
+    {
+#ifndef __EMSCRIPTEN__
+        void*       buffer = bank.data;
+        size_t      length = sizeof(bank.data);
+        const int   fd     = ::fileno(_stream);
+        const long  page   = ::sysconf(_SC_PAGESIZE);
+        const off_t offset = ::ftello(_stream);
+        struct stat status;
+        if((page <= 0) || (offset < 0) || ((reinterpret_cast<uintptr_t>(buffer) % page) != 0) || ((offset % page) != 0)) {
+            return false;
+        }
+        if((::fstat(fd, &status) != 0) || (S_ISREG(status.st_mode) == 0) || (status.st_size < static_cast<off_t>(offset + length))) {
+            return false;
+        }
+        if(::mmap(buffer, length, (PROT_READ | PROT_WRITE), (MAP_PRIVATE | MAP_FIXED), fd, offset) == MAP_FAILED) {
+            throw std::runtime_error("mmap() has failed");
+        }
+        if(::fseeko(_stream, static_cast<off_t>(offset + length), SEEK_SET) != 0) {
+            throw std::runtime_error("fseeko() has failed");
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    auto read(Bank& bank) -> void
     {
         uint8_t*   buffer = bank.data;
         size_t     length = countof(bank.data);
@@ -140,10 +250,24 @@ private: // private data
 
 namespace mmu {
 
-Instance::Instance(Interface& interface)
+Instance::Instance(Interface& interface, bool paged)
     : _interface(interface)
-    , _state()
+    , _state(allocate_state())
+    , _paged(paged)
+    , _windows()
+    , _rd_pages()
+    , _wr_pages()
+    , _attributes()
 {
+    if(_paged != false) {
+        set_attributes(0x00000, (MMU_ROM_PAGES * sizeof(Bank::data)), PAGE_RDONLY);
+    }
+    remap();
+}
+
+Instance::~Instance()
+{
+    release_state(_state);
 }
 
 auto Instance::reset() -> void
@@ -160,44 +284,47 @@ auto Instance::reset() -> void
         for(auto& bank : state.bank) {
             reset_bank(bank);
         }
+        for(auto& page : state.page) {
+            page &= 0x00;
+        }
+        state.paging &= 0x00;
     };
 
-    return reset_state(_state);
+    if(discard_state(_state) == false) {
+        reset_state(_state);
+    }
+    untrack_dirty();
 }
 
 auto Instance::clock() -> void
 {
 }
 
-auto Instance::rd_byte(uint16_t addr, uint8_t data) -> uint8_t
-{
-    const uint16_t bank_number = ((addr >> 14) & 0x0003);
-    const uint16_t bank_offset = ((addr >>  0) & 0x3fff);
-
-    return data = _state.bank[bank_number].data[bank_offset];
-}
+/*
+ * with the paged layout, the memory is made of 32 pages of rom followed by 32
+ * pages of ram (RC2014 512k rom/512k ram style). each 16kB window is mapped
+ * onto any page through the page registers (ports 0x78 to 0x7b), once the
+ * paging has been enabled (bit 0 of port 0x7c). while the paging is disabled,
+ * which is the case after a reset, every window shows the first rom page.
+ */
 
-auto Instance::wr_byte(uint16_t addr, uint8_t data) -> uint8_t
+auto Instance::wr_page(uint16_t port, uint8_t data) -> uint8_t
 {
-    const uint16_t bank_number = ((addr >> 14) & 0x0003);
-    const uint16_t bank_offset = ((addr >>  0) & 0x3fff);
-
-    if(addr == MMU_OREQ_ADDR) {
-        auto&    bank = _state.bank[bank_number];
-        uint8_t& oack = bank.data[MMU_OACK_ADDR & 0x3fff];
-        uint8_t& oreq = bank.data[MMU_OREQ_ADDR & 0x3fff];
-        uint8_t& ochr = bank.data[MMU_OCHR_ADDR & 0x3fff];
-        if(data != oreq) {
-            _interface.mmu_char_wr(*this, ochr);
-            ++oack;
+    if(_paged != false) {
+        if((port & 0x00fc) == MMU_PAGE_PORT) {
+            _state.page[port & 0x0003] = (data & MMU_PAGE_MASK);
+        }
+        else if((port & 0x00ff) == MMU_PAGE_ENBL) {
+            _state.paging = (data & 0x01);
         }
+        remap();
     }
-    return _state.bank[bank_number].data[bank_offset] = data;
+    return data;
 }
 
 auto Instance::load_bank(const std::string& filename, const int index) -> void
 {
-    if((index >= 0) && (index <= 3)) {
+    if((index >= 0) && (index < static_cast<int>(countof(_state.bank)))) {
         BankReader reader(filename);
         reader.load(_state.bank[index]);
     }
@@ -206,9 +333,25 @@ auto Instance::load_bank(const std::string& filename, const int index) -> void
     }
 }
 
+auto Instance::load_rom(const std::string& filename) -> void
+{
+    BankReader reader(filename);
+    size_t     count = reader.banks();
+
+    if(count > MMU_ROM_PAGES) {
+        count = MMU_ROM_PAGES;
+    }
+    else if(count == 0) {
+        throw std::runtime_error("load_rom() has failed (image is too small)");
+    }
+    for(size_t index = 0; index < count; ++index) {
+        reader.load(_state.bank[index]);
+    }
+}
+
 auto Instance::save_bank(const std::string& filename, const int index) -> void
 {
-    if((index >= 0) && (index <= 3)) {
+    if((index >= 0) && (index < static_cast<int>(countof(_state.bank)))) {
         BankWriter writer(filename);
         writer.save(_state.bank[index]);
     }
@@ -217,6 +360,192 @@ auto Instance::save_bank(const std::string& filename, const int index) -> void
     }
 }
 
+/*
+ * remap() caches the host address of the page mapped in each window and of
+ * each 256-byte page of the address space, so an access to the plain memory
+ * costs a single indexed load or store whatever the layout. the cpu reads the
+ * plain memory directly through the read pages. the page holding the output
+ * trap and the i/o-mapped pages are left out of the read pages, as are the
+ * windows sharing their page with another window. the page holding the output
+ * trap and the pages with any attribute are left out of the write pages. the
+ * accesses to the pages left out go through the slow paths. the interface is
+ * notified of every window whose mapping has changed.
+ */
+
+auto Instance::remap() -> void
+{
+    uint8_t pages[4];
+
+    auto page_of = [&](const uint16_t window) -> uint8_t
+    {
+        if(_paged == false) {
+            return window;
+        }
+        if(_state.paging == 0) {
+            return 0;
+        }
+        return _state.page[window] & MMU_PAGE_MASK;
+    };
+
+    auto is_aliased = [&](const uint16_t window) -> bool
+    {
+        for(uint16_t other = 0; other < countof(pages); ++other) {
+            if((other != window) && (pages[other] == pages[window])) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    auto map_window = [&](const uint16_t window) -> void
+    {
+        const bool     aliased = is_aliased(window);
+        const uint32_t first   = (window << 6);
+        bool           changed = false;
+        _windows[window] = _state.bank[pages[window]].data;
+        for(uint32_t page = first; page < (first + 64); ++page) {
+            uint8_t* const       data       = &_windows[window][(page << 8) & 0x3fff];
+            const uint8_t        attributes = _attributes[(pages[window] << 6) | (page & 0x3f)];
+            const uint8_t* const previous   = _rd_pages[page];
+            const bool           trapped    = (page == (MMU_OREQ_ADDR >> 8));
+            if((aliased == false) && (trapped == false) && ((attributes & PAGE_IOMAP) == 0)) {
+                _rd_pages[page] = data;
+            }
+            else {
+                _rd_pages[page] = nullptr;
+            }
+            if((trapped == false) && (attributes == 0)) {
+                _wr_pages[page] = data;
+            }
+            else {
+                _wr_pages[page] = nullptr;
+            }
+            if(_rd_pages[page] != previous) {
+                changed = true;
+            }
+        }
+        if(changed != false) {
+            _interface.mmu_page_sw(*this, (window << 14), 0x4000);
+        }
+    };
+
+    for(uint16_t window = 0; window < countof(pages); ++window) {
+        pages[window] = page_of(window);
+    }
+    for(uint16_t window = 0; window < countof(pages); ++window) {
+        map_window(window);
+    }
+}
+
+/*
+ * the attributes apply to the 256-byte pages of the physical memory. the
+ * writes to a read-only page are ignored, the writes to a write-watched page
+ * are reported to the interface once stored, the accesses to an i/o-mapped
+ * page are forwarded to the interface instead of the memory and the first
+ * write to a dirty-tracked page clears its attribute, so a page that has lost
+ * it has been written since it was armed. the pages without any attribute
+ * are accessed straight through the host pages, the others take the slow
+ * path, as does the page holding the output trap.
+ */
+
+auto Instance::get_attributes(uint32_t addr) const -> uint8_t
+{
+    const uint32_t page = (addr >> 8);
+
+    if(page < countof(_attributes)) {
+        return _attributes[page];
+    }
+    return 0x00;
+}
+
+auto Instance::set_attributes(uint32_t addr, uint32_t size, uint8_t attributes) -> void
+{
+    const uint32_t first = (addr >> 8);
+    const uint32_t last  = ((addr + size + 0xff) >> 8);
+
+    for(uint32_t page = first; (page < last) && (page < countof(_attributes)); ++page) {
+        _attributes[page] = attributes;
+    }
+    remap();
+}
+
+/*
+ * the dirty pages are tracked through the dirty-tracked attribute: once armed
+ * on every page, the first write to a page clears it and the page is dirty
+ * from then on, the following writes taking the fast path again. the pages
+ * are all dirty until the tracking has been armed, and again once the memory
+ * has been replaced as a whole (reset or restore).
+ */
+
+auto Instance::track_dirty() -> void
+{
+    for(auto& attributes : _attributes) {
+        attributes |= PAGE_DIRTY;
+    }
+    remap();
+}
+
+auto Instance::untrack_dirty() -> void
+{
+    for(auto& attributes : _attributes) {
+        attributes &= ~PAGE_DIRTY;
+    }
+    remap();
+}
+
+auto Instance::rd_slow(uint16_t addr, uint8_t data) -> uint8_t
+{
+    const uint16_t window   = ((addr >> 14) & 0x0003);
+    const uint16_t offset   = ((addr >>  0) & 0x3fff);
+    const uint32_t physical = ((_windows[window] - _state.bank[0].data) + offset);
+
+    if((_attributes[physical >> 8] & PAGE_IOMAP) != 0) {
+        return _interface.mmu_page_rd(*this, physical, data);
+    }
+    return data = _windows[window][offset];
+}
+
+auto Instance::wr_slow(uint16_t addr, uint8_t data) -> uint8_t
+{
+    const uint16_t window     = ((addr >> 14) & 0x0003);
+    const uint16_t offset     = ((addr >>  0) & 0x3fff);
+    const uint32_t physical   = ((_windows[window] - _state.bank[0].data) + offset);
+    uint8_t&       attributes = _attributes[physical >> 8];
+
+    auto output_trap = [&]() -> void
+    {
+        uint8_t* bank = _windows[window];
+        uint8_t& oack = bank[MMU_OACK_ADDR & 0x3fff];
+        uint8_t& oreq = bank[MMU_OREQ_ADDR & 0x3fff];
+        uint8_t& ochr = bank[MMU_OCHR_ADDR & 0x3fff];
+        if(data != oreq) {
+            _interface.mmu_char_wr(*this, ochr);
+            ++oack;
+        }
+    };
+
+    if(addr == MMU_OREQ_ADDR) {
+        output_trap();
+    }
+    if((attributes & PAGE_IOMAP) != 0) {
+        return _interface.mmu_page_wr(*this, physical, data);
+    }
+    if((attributes & PAGE_RDONLY) != 0) {
+        return data;
+    }
+    if((attributes & PAGE_DIRTY) != 0) {
+        attributes &= ~PAGE_DIRTY;
+        if((attributes == 0) && ((addr >> 8) != (MMU_OREQ_ADDR >> 8))) {
+            _wr_pages[addr >> 8] = &_windows[window][offset & 0x3f00];
+        }
+    }
+    _windows[window][offset] = data;
+    if((attributes & PAGE_WWATCH) != 0) {
+        return _interface.mmu_page_wr(*this, physical, data);
+    }
+    return data;
+}
+
 }
 
 // ---------------------------------------------------------------------------
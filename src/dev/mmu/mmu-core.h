@@ -49,7 +49,9 @@ namespace mmu {
 
 struct State
 {
-    Bank bank[4];
+    Bank    bank[64]; /* physical pages  */
+    uint8_t page[4];  /* page registers  */
+    uint8_t paging;   /* paging enable   */
 };
 
 }
@@ -62,35 +64,106 @@ namespace mmu {
 
 class Instance
 {
+public: // public constants
+    static constexpr uint8_t PAGE_RDONLY = 0x01; /* read-only     */
+    static constexpr uint8_t PAGE_WWATCH = 0x02; /* write-watched */
+    static constexpr uint8_t PAGE_IOMAP  = 0x04; /* i/o-mapped    */
+    static constexpr uint8_t PAGE_DIRTY  = 0x08; /* dirty-tracked */
+
 public: // public interface
-    Instance(Interface&);
+    Instance(Interface&, bool paged);
 
     Instance(const Instance&) = delete;
 
     Instance& operator=(const Instance&) = delete;
 
-    virtual ~Instance() = default;
+    virtual ~Instance();
 
     auto reset() -> void;
 
     auto clock() -> void;
 
-    auto rd_byte(uint16_t addr, uint8_t data) -> uint8_t;
+    auto rd_byte(uint16_t addr, uint8_t data) -> uint8_t
+    {
+        const uint8_t* const page = _rd_pages[addr >> 8];
 
-    auto wr_byte(uint16_t addr, uint8_t data) -> uint8_t;
+        if(page != nullptr) {
+            return data = page[addr & 0x00ff];
+        }
+        return rd_slow(addr, data);
+    }
+
+    auto wr_byte(uint16_t addr, uint8_t data) -> uint8_t
+    {
+        uint8_t* const page = _wr_pages[addr >> 8];
+
+        if(page != nullptr) {
+            return page[addr & 0x00ff] = data;
+        }
+        return wr_slow(addr, data);
+    }
+
+    auto wr_page(uint16_t port, uint8_t data) -> uint8_t;
 
     auto load_bank(const std::string& filename, const int index) -> void;
 
+    auto load_rom(const std::string& filename) -> void;
+
     auto save_bank(const std::string& filename, const int index) -> void;
 
+    auto remap() -> void;
+
+    auto get_attributes(uint32_t addr) const -> uint8_t;
+
+    auto set_attributes(uint32_t addr, uint32_t size, uint8_t attributes) -> void;
+
+    auto track_dirty() -> void;
+
+    auto untrack_dirty() -> void;
+
+    auto is_dirty(uint32_t page) const -> bool
+    {
+        return (_attributes[page] & PAGE_DIRTY) == 0;
+    }
+
+    auto physical(uint16_t addr) const -> uint32_t
+    {
+        return (_windows[(addr >> 14) & 0x0003] - _state.bank[0].data) + (addr & 0x3fff);
+    }
+
+    auto pages() const -> uint32_t
+    {
+        return sizeof(_attributes);
+    }
+
+    auto paged() const -> bool
+    {
+        return _paged;
+    }
+
+    auto rd_pages() const -> const uint8_t* const*
+    {
+        return _rd_pages;
+    }
+
     auto operator->() -> State*
     {
         return &_state;
     }
 
+protected: // protected interface
+    auto rd_slow(uint16_t addr, uint8_t data) -> uint8_t;
+
+    auto wr_slow(uint16_t addr, uint8_t data) -> uint8_t;
+
 protected: // protected data
-    Interface& _interface;
-    State      _state;
+    Interface&     _interface;
+    State&         _state;
+    const bool     _paged;
+    uint8_t*       _windows[4];
+    const uint8_t* _rd_pages[256];
+    uint8_t*       _wr_pages[256];
+    uint8_t        _attributes[64 * 64];
 };
 
 }
@@ -113,6 +186,12 @@ public: // public interface
     virtual ~Interface() = default;
 
     virtual auto mmu_char_wr(Instance&, uint8_t data) -> void = 0;
+
+    virtual auto mmu_page_sw(Instance&, uint16_t addr, uint32_t size) -> void = 0;
+
+    virtual auto mmu_page_rd(Instance&, uint32_t addr, uint8_t data) -> uint8_t = 0;
+
+    virtual auto mmu_page_wr(Instance&, uint32_t addr, uint8_t data) -> uint8_t = 0;
 };
 
 }
@@ -26,11 +26,17 @@
 #include <memory>
 #include <string>
 #include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
 #include <iostream>
 #include <stdexcept>
 #include <unistd.h>
+#include <fcntl.h>
 #include <termios.h>
 #include <poll.h>
+#include <sys/uio.h>
 #include "sio-core.h"
 
 // ---------------------------------------------------------------------------
@@ -41,6 +47,7 @@ namespace sio {
 
 using pollfd_type  = struct pollfd;
 using termios_type = struct termios;
+using iovec_type   = struct iovec;
 
 }
 
@@ -145,18 +152,460 @@ struct ACIA
 
 }
 
+// ---------------------------------------------------------------------------
+// sio::Queue
+// ---------------------------------------------------------------------------
+
+/*
+ * single-producer/single-consumer lock-free ring. the indexes are free-running
+ * and only the producer stores the tail, only the consumer stores the head.
+ * the bulk transfers hand the contiguous regions of the ring to readv() and
+ * writev() so a batch of characters costs a single syscall, the reads being
+ * bounded by a runtime limit no greater than the ring size.
+ */
+
+namespace sio {
+
+template <uint32_t SIZE>
+class Queue
+{
+public: // public interface
+    static constexpr uint32_t MASK = SIZE - 1;
+
+    Queue()
+        : _head(0)
+        , _tail(0)
+        , _data()
+    {
+    }
+
+    auto size() const -> uint32_t
+    {
+        return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+    }
+
+    auto push(uint8_t data) -> bool
+    {
+        const uint32_t tail = _tail.load(std::memory_order_relaxed);
+        const uint32_t head = _head.load(std::memory_order_acquire);
+        if((tail - head) >= SIZE) {
+            return false;
+        }
+        _data[tail & MASK] = data;
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    auto pop(uint8_t& data) -> bool
+    {
+        const uint32_t head = _head.load(std::memory_order_relaxed);
+        const uint32_t tail = _tail.load(std::memory_order_acquire);
+        if(head == tail) {
+            return false;
+        }
+        data = _data[head & MASK];
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    auto read_from(int fd, uint32_t limit) -> ssize_t
+    {
+        const uint32_t tail  = _tail.load(std::memory_order_relaxed);
+        const uint32_t head  = _head.load(std::memory_order_acquire);
+        const uint32_t used  = (tail - head);
+        iovec_type     iov[2];
+        const int      count = split(iov, tail, (used < limit ? limit - used : 0));
+        const ssize_t  rc    = (count != 0 ? ::readv(fd, iov, count) : 0);
+        if(rc > 0) {
+            _tail.store(tail + static_cast<uint32_t>(rc), std::memory_order_release);
+        }
+        return rc;
+    }
+
+    auto write_to(int fd) -> ssize_t
+    {
+        const uint32_t head  = _head.load(std::memory_order_relaxed);
+        const uint32_t tail  = _tail.load(std::memory_order_acquire);
+        iovec_type     iov[2];
+        const int      count = split(iov, head, (tail - head));
+        const ssize_t  rc    = (count != 0 ? ::writev(fd, iov, count) : 0);
+        if(rc > 0) {
+            _head.store(head + static_cast<uint32_t>(rc), std::memory_order_release);
+        }
+        return rc;
+    }
+
+private: // private interface
+    auto split(iovec_type iov[2], uint32_t index, uint32_t length) -> int
+    {
+        const uint32_t offset = (index & MASK);
+        const uint32_t first  = (length < (SIZE - offset) ? length : (SIZE - offset));
+        int            count  = 0;
+        if(first != 0) {
+            iov[count].iov_base = &_data[offset];
+            iov[count].iov_len  = first;
+            ++count;
+        }
+        if(length != first) {
+            iov[count].iov_base = &_data[0];
+            iov[count].iov_len  = (length - first);
+            ++count;
+        }
+        return count;
+    }
+
+private: // private data
+    std::atomic<uint32_t> _head;
+    std::atomic<uint32_t> _tail;
+    uint8_t               _data[SIZE];
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// sio::Worker
+// ---------------------------------------------------------------------------
+
+/*
+ * the worker owns all the host file descriptor I/O of a serial port. a
+ * dedicated thread blocks in poll() on the input and on a wakeup pipe, fills
+ * the receive queue and drains the transmit queue, so the emulation thread
+ * only checks the queues. the thread is woken up on a newline, past the
+ * flush threshold, on each frame when some output is pending, or when the
+ * receive queue is no longer full. without threads (emscripten), the same
+ * queues are serviced synchronously from the emulation thread. a polled
+ * worker has no thread either, its queues are serviced by the embedder
+ * through service(), which expects non-blocking file descriptors.
+ *
+ * a full transmit queue is never dropped: drain() waits until the thread has
+ * made room, or writes the queue itself and waits for the output to accept
+ * more when there is no thread. an output that fails for good swallows the
+ * bytes instead of blocking forever.
+ */
+
+namespace sio {
+
+class Worker
+{
+public: // public interface
+    static constexpr uint32_t RX_SIZE  = 65536; /* receive queue size  */
+    static constexpr uint32_t TX_SIZE  = 4096;  /* transmit queue size */
+    static constexpr uint32_t TX_FLUSH = 1024;  /* flush threshold     */
+
+    Worker(int rx, int tx, bool polled)
+        : _rx(rx)
+        , _tx(tx)
+        , _rx_limit(RX_SIZE)
+        , _rx_queue()
+        , _tx_queue()
+        , _wakeup{-1, -1}
+        , _quit(false)
+#ifndef __EMSCRIPTEN__
+        , _tx_mutex()
+        , _tx_cond()
+        , _thread()
+#endif
+    {
+#ifndef __EMSCRIPTEN__
+        if(((_rx >= 0) || (_tx.load() >= 0)) && (polled == false)) {
+            if(::pipe(_wakeup) != 0) {
+                throw std::runtime_error("pipe() has failed");
+            }
+            static_cast<void>(::fcntl(_wakeup[0], F_SETFL, O_NONBLOCK));
+            static_cast<void>(::fcntl(_wakeup[1], F_SETFL, O_NONBLOCK));
+            _thread = std::thread([&]() -> void { loop(); });
+        }
+#endif
+    }
+
+    Worker(const Worker&) = delete;
+
+    Worker& operator=(const Worker&) = delete;
+
+    virtual ~Worker()
+    {
+#ifndef __EMSCRIPTEN__
+        if(_thread.joinable()) {
+            _quit.store(true);
+            notify();
+            _thread.join();
+        }
+        else {
+            service_tx();
+            while((_tx.load() >= 0) && (_tx_queue.size() != 0)) {
+                wait_tx();
+                service_tx();
+            }
+        }
+        if(_wakeup[0] != -1) {
+            static_cast<void>(::close(_wakeup[0]));
+        }
+        if(_wakeup[1] != -1) {
+            static_cast<void>(::close(_wakeup[1]));
+        }
+#else
+        flush();
+#endif
+    }
+
+    auto set_rx_limit(uint32_t limit) -> void
+    {
+        if(limit == 0) {
+            limit = 1;
+        }
+        if(limit > RX_SIZE) {
+            limit = RX_SIZE;
+        }
+        _rx_limit.store(limit);
+        notify();
+    }
+
+    auto receive(uint8_t& data) -> bool
+    {
+#ifdef __EMSCRIPTEN__
+        if((_rx >= 0) && (_rx_queue.size() < _rx_limit.load())) {
+            pollfd_type pollfd;
+            pollfd.fd      = _rx;
+            pollfd.events  = (POLLIN | POLLERR | POLLHUP);
+            pollfd.revents = 0;
+            if((::poll(&pollfd, 1, 0) > 0) && (pollfd.revents != 0)) {
+                service_rx();
+            }
+        }
+#endif
+        const bool full = (_rx_queue.size() >= _rx_limit.load());
+        if(_rx_queue.pop(data) == false) {
+            return false;
+        }
+        if(full != false) {
+            notify();
+        }
+        return true;
+    }
+
+    auto transmit(uint8_t data) -> bool
+    {
+        if(_tx.load() < 0) {
+            return true;
+        }
+        if(_tx_queue.push(data) == false) {
+            flush();
+            return false;
+        }
+        if((data == '\n') || (_tx_queue.size() >= TX_FLUSH)) {
+            flush();
+        }
+        return true;
+    }
+
+    auto service() -> void
+    {
+        if((_rx >= 0) && (_rx_queue.size() < _rx_limit.load())) {
+            service_rx();
+        }
+        service_tx();
+    }
+
+    auto rx_pending() const -> bool
+    {
+        return _rx_queue.size() != 0;
+    }
+
+    auto tx_pending() const -> bool
+    {
+        return _tx_queue.size() != 0;
+    }
+
+    auto flush() -> void
+    {
+        if(_tx_queue.size() != 0) {
+#ifndef __EMSCRIPTEN__
+            notify();
+#else
+            service_tx();
+#endif
+        }
+    }
+
+    auto drain() -> void
+    {
+#ifndef __EMSCRIPTEN__
+        if(_thread.joinable()) {
+            std::unique_lock<std::mutex> lock(_tx_mutex);
+            notify();
+            _tx_cond.wait(lock, [&]() -> bool
+            {
+                return (_tx_queue.size() < TX_SIZE) || (_tx.load() < 0);
+            });
+            return;
+        }
+        service_tx();
+        if((_tx.load() >= 0) && (_tx_queue.size() >= TX_SIZE)) {
+            wait_tx();
+        }
+#else
+        service_tx();
+#endif
+    }
+
+private: // private interface
+    auto notify() -> void
+    {
+        if(_wakeup[1] != -1) {
+            const uint8_t data = 0;
+            const auto rc = ::write(_wakeup[1], &data, sizeof(data));
+            static_cast<void>(rc);
+        }
+    }
+
+    auto service_rx() -> void
+    {
+        const auto rc = _rx_queue.read_from(_rx, _rx_limit.load());
+        if((rc == 0) || ((rc < 0) && (errno != EINTR) && (errno != EAGAIN))) {
+            _rx = -1;
+        }
+    }
+
+    auto service_tx() -> void
+    {
+        while((_tx.load() >= 0) && (_tx_queue.size() != 0)) {
+            const auto rc = _tx_queue.write_to(_tx.load());
+            if((rc < 0) && (errno == EINTR)) {
+                continue;
+            }
+            if((rc < 0) && (errno != EAGAIN)) {
+                uint8_t data = 0;
+                while(_tx_queue.pop(data) != false) {
+                    continue;
+                }
+                _tx.store(-1);
+            }
+            if(rc <= 0) {
+                break;
+            }
+        }
+    }
+
+    auto wait_tx() -> void
+    {
+        pollfd_type pollfd;
+        pollfd.fd      = _tx.load();
+        pollfd.events  = (POLLOUT);
+        pollfd.revents = 0;
+        static_cast<void>(::poll(&pollfd, 1, -1));
+    }
+
+#ifndef __EMSCRIPTEN__
+    auto loop() -> void
+    {
+        constexpr int count = 3;
+        pollfd_type   pollfds[count];
+        pollfd_type&  poll_wk(pollfds[0]);
+        pollfd_type&  poll_rd(pollfds[1]);
+        pollfd_type&  poll_wr(pollfds[2]);
+
+        auto do_init = [&]() -> void
+        {
+            for(auto& pollfd : pollfds) {
+                pollfd.fd      = -1;
+                pollfd.events  =  0;
+                pollfd.revents =  0;
+            }
+            poll_wk.fd     = (_wakeup[0]);
+            poll_wk.events = (POLLIN);
+            if((_rx >= 0) && (_rx_queue.size() < _rx_limit.load())) {
+                poll_rd.fd     = (_rx);
+                poll_rd.events = (POLLIN | POLLERR | POLLHUP);
+            }
+            if((_tx.load() >= 0) && (_tx_queue.size() != 0)) {
+                poll_wr.fd     = (_tx.load());
+                poll_wr.events = (POLLOUT);
+            }
+        };
+
+        auto do_poll = [&]() -> void
+        {
+            const auto ready = ::poll(pollfds, count, -1);
+            if(ready > 0) {
+                if((poll_wk.revents & POLLIN) != 0) {
+                    uint8_t buffer[64];
+                    while(::read(_wakeup[0], buffer, sizeof(buffer)) > 0) {
+                        continue;
+                    }
+                }
+                if(poll_rd.revents != 0) {
+                    service_rx();
+                }
+            }
+        };
+
+        auto do_wake = [&]() -> void
+        {
+            const std::lock_guard<std::mutex> lock(_tx_mutex);
+            _tx_cond.notify_all();
+        };
+
+        auto do_loop = [&]() -> void
+        {
+            while(_quit.load() == false) {
+                service_tx();
+                do_wake();
+                do_init();
+                do_poll();
+            }
+            service_tx();
+            do_wake();
+        };
+
+        return do_loop();
+    }
+#endif
+
+private: // private data
+    int                     _rx;
+    std::atomic<int>        _tx;
+    std::atomic<uint32_t>   _rx_limit;
+    Queue<RX_SIZE>          _rx_queue;
+    Queue<TX_SIZE>          _tx_queue;
+    int                     _wakeup[2];
+    std::atomic<bool>       _quit;
+#ifndef __EMSCRIPTEN__
+    std::mutex              _tx_mutex;
+    std::condition_variable _tx_cond;
+    std::thread             _thread;
+#endif
+};
+
+}
+
 // ---------------------------------------------------------------------------
 // sio::Instance
 // ---------------------------------------------------------------------------
 
+/*
+ * the received characters wait in the host-side fifo of the worker and are
+ * handed to the guest one at a time, with the usual RDRF/IRQ semantics. when
+ * the flow control is enabled, no character is handed while the guest holds
+ * RTS high (CR6 set and CR5 clear), so a bulk load is throttled by the guest
+ * itself and nothing is dropped. likewise, print() waits for room in the
+ * transmit queue rather than dropping the characters of the emulator.
+ */
+
 namespace sio {
 
-Instance::Instance(Interface& interface, int rx, int tx)
+Instance::Instance(Interface& interface, int rx, int tx, bool polled)
     : _interface(interface)
     , _state()
+    , _worker()
 {
     _state.rx = rx;
     _state.tx = tx;
+    _worker.reset(new Worker(rx, tx, polled));
+}
+
+Instance::~Instance()
+{
+    _worker.reset();
 }
 
 auto Instance::reset() -> void
@@ -172,47 +621,39 @@ auto Instance::reset() -> void
     _state.rx_data = 0;
     _state.tx_data = 0;
     _state.enabled = 0;
+    _worker->set_rx_limit(_state.rx_fifo);
 }
 
 auto Instance::clock() -> void
 {
-    constexpr int count = 2;
-    pollfd_type   pollfds[count];
-    pollfd_type&  poll_rd(pollfds[0]);
-    pollfd_type&  poll_wr(pollfds[1]);
-
-    auto do_init = [&]() -> void
+    auto rts_asserted = [&]() -> bool
     {
-        for(auto& pollfd : pollfds) {
-            pollfd.fd      = -1;
-            pollfd.events  =  0;
-            pollfd.revents =  0;
-        }
-        if((_state.rx >= 0) && ((_state.status & ACIA::SR_RDRF) == 0)) {
-            poll_rd.fd     = (_state.rx);
-            poll_rd.events = (POLLIN | POLLERR | POLLHUP);
-        }
-        if((_state.tx >= 0) && ((_state.status & ACIA::SR_TDRE) == 0)) {
-            poll_wr.fd     = (_state.tx);
-            poll_wr.events = (POLLOUT | POLLERR | POLLHUP);
+        if(_state.rx_flow != 0) {
+            return (_state.control & (ACIA::CR_CR6 | ACIA::CR_CR5)) != ACIA::CR_CR6;
         }
+        return true;
     };
 
-    auto do_poll = [&]() -> void
+    auto do_receive = [&]() -> void
     {
-        const auto ready = ::poll(pollfds, count, 0);
-        if(ready > 0) {
-            if((poll_rd.revents & POLLIN) != 0) {
+        if(((_state.status & ACIA::SR_RDRF) == 0) && (rts_asserted() != false)) {
+            if(_interface.sio_rx_data(*this, _state.rx_data) != false) {
                 _state.status |= (ACIA::SR_RDRF | ACIA::SR_IRQ);
-                const auto rc = ::read(_state.rx, &_state.rx_data, sizeof(_state.rx_data));
-                static_cast<void>(rc);
             }
-            if((poll_wr.revents & POLLOUT) != 0) {
+        }
+    };
+
+    auto do_transmit = [&]() -> void
+    {
+        if((_state.tx >= 0) && ((_state.status & ACIA::SR_TDRE) == 0)) {
+            if(_interface.sio_tx_data(*this, _state.tx_data) != false) {
                 _state.status |= (ACIA::SR_TDRE);
-                const auto rc = ::write(_state.tx, &_state.tx_data, sizeof(_state.tx_data));
-                static_cast<void>(rc);
             }
         }
+    };
+
+    auto do_interrupt = [&]() -> void
+    {
         if(((_state.status  & ACIA::SR_IRQ) != 0)
         && ((_state.control & ACIA::CR_IRQ) != 0)) {
             _interface.sio_intr_rq(*this);
@@ -222,8 +663,9 @@ auto Instance::clock() -> void
     auto do_clock = [&]() -> void
     {
         if(_state.enabled != 0) {
-            do_init();
-            do_poll();
+            do_receive();
+            do_transmit();
+            do_interrupt();
         }
     };
 
@@ -296,12 +738,54 @@ auto Instance::print(uint8_t data) -> uint8_t
 {
     _state.tx_data = data;
     if(_state.tx >= 0) {
-        const auto rc = ::write(_state.tx, &data, sizeof(data));
-        static_cast<void>(rc);
+        while(_worker->transmit(data) == false) {
+            _worker->drain();
+        }
     }
     return data;
 }
 
+auto Instance::receive(uint8_t& data) -> bool
+{
+    return _worker->receive(data);
+}
+
+auto Instance::transmit(uint8_t data) -> bool
+{
+    return _worker->transmit(data);
+}
+
+auto Instance::service() -> void
+{
+    _worker->service();
+}
+
+auto Instance::idle() const -> bool
+{
+    if(_state.enabled == 0) {
+        return true;
+    }
+    if((_state.status & (ACIA::SR_RDRF | ACIA::SR_TDRE)) != ACIA::SR_TDRE) {
+        return false;
+    }
+    return (_worker->rx_pending() == false) && (_worker->tx_pending() == false);
+}
+
+auto Instance::tx_pending() const -> bool
+{
+    return _worker->tx_pending();
+}
+
+auto Instance::flush() -> void
+{
+    _worker->flush();
+}
+
+auto Instance::drain() -> void
+{
+    _worker->drain();
+}
+
 }
 
 // ---------------------------------------------------------------------------
@@ -25,6 +25,7 @@ namespace sio {
 
 class Instance;
 class Interface;
+class Worker;
 
 }
 
@@ -36,13 +37,15 @@ namespace sio {
 
 struct State
 {
-    int     rx      = -1; /* input file descriptor  */
-    int     tx      = -1; /* output file descriptor */
-    uint8_t status  =  0; /* status register        */
-    uint8_t control =  0; /* control register       */
-    uint8_t rx_data =  0; /* receive data register  */
-    uint8_t tx_data =  0; /* transmit data register */
-    uint8_t enabled =  0; /* is enabled             */
+    int      rx      =   -1; /* input file descriptor    */
+    int      tx      =   -1; /* output file descriptor   */
+    uint32_t rx_fifo = 4096; /* receive fifo size        */
+    uint8_t  rx_flow =    0; /* rts/cts flow control     */
+    uint8_t  status  =    0; /* status register          */
+    uint8_t  control =    0; /* control register         */
+    uint8_t  rx_data =    0; /* receive data register    */
+    uint8_t  tx_data =    0; /* transmit data register   */
+    uint8_t  enabled =    0; /* is enabled               */
 };
 
 }
@@ -56,13 +59,13 @@ namespace sio {
 class Instance
 {
 public: // public interface
-    Instance(Interface&, int rx, int tx);
+    Instance(Interface&, int rx, int tx, bool polled);
 
     Instance(const Instance&) = delete;
 
     Instance& operator=(const Instance&) = delete;
 
-    virtual ~Instance() = default;
+    virtual ~Instance();
 
     auto reset() -> void;
 
@@ -78,14 +81,29 @@ public: // public interface
 
     auto print(uint8_t data) -> uint8_t;
 
+    auto receive(uint8_t& data) -> bool;
+
+    auto transmit(uint8_t data) -> bool;
+
+    auto service() -> void;
+
+    auto idle() const -> bool;
+
+    auto tx_pending() const -> bool;
+
+    auto flush() -> void;
+
+    auto drain() -> void;
+
     auto operator->() -> State*
     {
         return &_state;
     }
 
 protected: // protected data
-    Interface& _interface;
-    State      _state;
+    Interface&              _interface;
+    State                   _state;
+    std::unique_ptr<Worker> _worker;
 };
 
 }
@@ -108,6 +126,10 @@ public: // public interface
     virtual ~Interface() = default;
 
     virtual auto sio_intr_rq(Instance&) -> void = 0;
+
+    virtual auto sio_rx_data(Instance&, uint8_t& data) -> bool = 0;
+
+    virtual auto sio_tx_data(Instance&, uint8_t data) -> bool = 0;
 };
 
 }
@@ -34,6 +34,14 @@
 // vdu::Instance
 // ---------------------------------------------------------------------------
 
+/*
+ * the sync counters are not clocked on each tick, the owner asks for the
+ * number of ticks until the next sync with next() and then advances the
+ * counters by that amount with clock(). the hsync is left out of next() and
+ * its callback is skipped when hsync is cleared, so a vdu nobody listens to
+ * for hsync only wakes up once per frame.
+ */
+
 namespace vdu {
 
 Instance::Instance(Interface& interface)
@@ -51,19 +59,46 @@ auto Instance::reset() -> void
         state.vfreq |= 0; // don't reset
         state.hcntr &= 0; // reset value
         state.vcntr &= 0; // reset value
+        state.hsync |= 0; // don't reset
     };
 
     return reset_state(_state);
 }
 
-auto Instance::clock() -> void
+auto Instance::next() const -> uint32_t
 {
-    if((_state.hcntr += _state.hfreq) >= _state.clock) {
-        _state.hcntr -= _state.clock;
-        _interface.vdu_sync_hs(*this, false);
+    auto ticks_until = [&](const uint32_t cntr, const uint32_t freq) -> uint32_t
+    {
+        return ((_state.clock - cntr) + (freq - 1)) / freq;
+    };
+
+    const uint32_t hnext = ticks_until(_state.hcntr, _state.hfreq);
+    const uint32_t vnext = ticks_until(_state.vcntr, _state.vfreq);
+
+    if((_state.hsync != 0) && (hnext < vnext)) {
+        return hnext;
+    }
+    return vnext;
+}
+
+auto Instance::clock(uint32_t ticks) -> void
+{
+    auto advance = [&](uint32_t& cntr, const uint32_t freq) -> uint32_t
+    {
+        const uint64_t total = cntr + (static_cast<uint64_t>(ticks) * freq);
+        cntr = static_cast<uint32_t>(total % _state.clock);
+        return static_cast<uint32_t>(total / _state.clock);
+    };
+
+    uint32_t hsyncs = advance(_state.hcntr, _state.hfreq);
+    uint32_t vsyncs = advance(_state.vcntr, _state.vfreq);
+
+    if(_state.hsync != 0) {
+        while(hsyncs-- != 0) {
+            _interface.vdu_sync_hs(*this, false);
+        }
     }
-    if((_state.vcntr += _state.vfreq) >= _state.clock) {
-        _state.vcntr -= _state.clock;
+    while(vsyncs-- != 0) {
         _interface.vdu_sync_vs(*this, false);
     }
 }
@@ -41,6 +41,7 @@ struct State
     uint32_t vfreq = 60;
     uint32_t hcntr = 0;
     uint32_t vcntr = 0;
+    uint32_t hsync = 1;
 };
 
 }
@@ -64,7 +65,9 @@ public: // public interface
 
     auto reset() -> void;
 
-    auto clock() -> void;
+    auto next() const -> uint32_t;
+
+    auto clock(uint32_t ticks) -> void;
 
     auto operator->() -> State*
     {
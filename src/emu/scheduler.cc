@@ -0,0 +1,76 @@
+/*
+ * scheduler.cc - Copyright (c) 2001-2026 - Olivier Poncet
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cstdarg>
+#include <memory>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+#include "scheduler.h"
+
+// ---------------------------------------------------------------------------
+// emu::Scheduler
+// ---------------------------------------------------------------------------
+
+/*
+ * the queue is kept sorted by decreasing timestamp, so the next event to be
+ * dispatched always sits at the back of the array. events sharing the same
+ * timestamp are dispatched by increasing type, which gives the caller a
+ * stable and deterministic ordering between devices. an event type must not
+ * be inserted twice, a pending event has to be removed before being moved.
+ */
+
+namespace emu {
+
+Scheduler::Scheduler()
+    : _state()
+{
+}
+
+auto Scheduler::reset() -> void
+{
+    _state.now   &= 0;
+    _state.count &= 0;
+}
+
+auto Scheduler::remove(uint32_t type) -> void
+{
+    uint32_t index = 0;
+    while((index < _state.count) && (_state.queue[index].type != type)) {
+        ++index;
+    }
+    if(index < _state.count) {
+        while(++index < _state.count) {
+            _state.queue[index - 1] = _state.queue[index];
+        }
+        --_state.count;
+    }
+}
+
+}
+
+// ---------------------------------------------------------------------------
+// End-Of-File
+// ---------------------------------------------------------------------------
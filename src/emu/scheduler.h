@@ -0,0 +1,154 @@
+/*
+ * scheduler.h - Copyright (c) 2001-2026 - Olivier Poncet
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef __EMU_Scheduler_h__
+#define __EMU_Scheduler_h__
+
+// ---------------------------------------------------------------------------
+// forward declarations
+// ---------------------------------------------------------------------------
+
+namespace emu {
+
+class Scheduler;
+
+}
+
+// ---------------------------------------------------------------------------
+// emu::SchedulerEvent
+// ---------------------------------------------------------------------------
+
+namespace emu {
+
+struct SchedulerEvent
+{
+    uint64_t time = 0; /* absolute timestamp */
+    uint32_t type = 0; /* event type         */
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// emu::SchedulerState
+// ---------------------------------------------------------------------------
+
+namespace emu {
+
+struct SchedulerState
+{
+    static constexpr uint32_t MAX_EVENTS = 8;
+
+    uint64_t       now   = 0;      /* current timestamp */
+    uint32_t       count = 0;      /* pending events    */
+    SchedulerEvent queue[MAX_EVENTS];
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// emu::Scheduler
+// ---------------------------------------------------------------------------
+
+namespace emu {
+
+class Scheduler
+{
+public: // public interface
+    Scheduler();
+
+    Scheduler(const Scheduler&) = default;
+
+    Scheduler& operator=(const Scheduler&) = default;
+
+    virtual ~Scheduler() = default;
+
+    auto reset() -> void;
+
+    auto remove(uint32_t type) -> void;
+
+    auto insert(uint32_t type, uint64_t time) -> void
+    {
+        uint32_t index = _state.count;
+        if(index >= SchedulerState::MAX_EVENTS) {
+            throw std::runtime_error("insert() has failed (queue is full)");
+        }
+        while((index != 0) && (before(_state.queue[index - 1], time, type))) {
+            _state.queue[index] = _state.queue[index - 1];
+            --index;
+        }
+        _state.queue[index].time = time;
+        _state.queue[index].type = type;
+        ++_state.count;
+    }
+
+    auto pop() -> SchedulerEvent
+    {
+        if(_state.count == 0) {
+            throw std::runtime_error("pop() has failed (queue is empty)");
+        }
+        return _state.queue[--_state.count];
+    }
+
+    auto advance(uint64_t time) -> void
+    {
+        if(time >= _state.now) {
+            _state.now = time;
+        }
+    }
+
+    auto now() const -> uint64_t
+    {
+        return _state.now;
+    }
+
+    auto next() const -> uint64_t
+    {
+        if(_state.count != 0) {
+            return _state.queue[_state.count - 1].time;
+        }
+        return UINT64_MAX;
+    }
+
+    auto empty() const -> bool
+    {
+        return _state.count == 0;
+    }
+
+    auto operator->() -> SchedulerState*
+    {
+        return &_state;
+    }
+
+private: // private interface
+    static auto before(const SchedulerEvent& event, uint64_t time, uint32_t type) -> bool
+    {
+        if(event.time != time) {
+            return event.time < time;
+        }
+        return event.type < type;
+    }
+
+private: // private data
+    SchedulerState _state;
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// End-Of-File
+// ---------------------------------------------------------------------------
+
+#endif /* __EMU_Scheduler_h__ */
@@ -0,0 +1,52 @@
+/*
+ * virtual-machine-cpu.cc - Copyright (c) 2001-2026 - Olivier Poncet
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cstdarg>
+#include <memory>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+#include "virtual-machine.h"
+#include "dev/cpu/cpu-core.inc"
+
+// ---------------------------------------------------------------------------
+// cpu::Core<emu::VirtualMachine>
+// ---------------------------------------------------------------------------
+
+/*
+ * the virtual machine cpu is bound to the virtual machine itself, its memory
+ * requests being inlined into the core instead of going through the virtual
+ * cpu::Interface.
+ */
+
+namespace cpu {
+
+template class Core<emu::VirtualMachine>;
+
+}
+
+// ---------------------------------------------------------------------------
+// End-Of-File
+// ---------------------------------------------------------------------------
@@ -26,10 +26,419 @@
 #include <memory>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <random>
+#include <thread>
 #include <iostream>
 #include <stdexcept>
 #include "virtual-machine.h"
 
+// ---------------------------------------------------------------------------
+// <anonymous>::vm_events
+// ---------------------------------------------------------------------------
+
+namespace {
+
+constexpr uint32_t VM_EVENT_VDU = 0; /* vdu clock      */
+constexpr uint32_t VM_EVENT_SIO = 1; /* sio clock      */
+constexpr uint32_t VM_EVENT_WDT = 2; /* watchdog reset */
+constexpr uint32_t VM_EVENT_CHK = 3; /* checkpoint     */
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::vm_history
+// ---------------------------------------------------------------------------
+
+namespace {
+
+constexpr uint8_t  VM_INPUT_RX    = 0;     /* byte received     */
+constexpr uint8_t  VM_INPUT_TX    = 1;     /* transmit stalled  */
+constexpr uint64_t VM_STEP_WINDOW = 256;   /* step back window  */
+constexpr uint64_t VM_WATCH_CHUNK = 65536; /* run back chunk    */
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::vm_input
+// ---------------------------------------------------------------------------
+
+namespace {
+
+constexpr char     VM_INPUT_MAGIC[8] = { 'V', 'Z', '8', '0', 'I', 'N', 'P', 'T' };
+constexpr uint32_t VM_INPUT_VERSION  = 1;
+constexpr uint8_t  VM_INPUT_BYTE     = 0; /* byte received  */
+constexpr uint8_t  VM_INPUT_END      = 1; /* end of session */
+
+struct InputHeader
+{
+    char     magic[8]; /* file magic     */
+    uint32_t version;  /* format version */
+    uint32_t reserved; /* reserved       */
+};
+
+struct InputRecord
+{
+    uint64_t time;        /* emulated cycle */
+    uint8_t  type;        /* record type    */
+    uint8_t  device;      /* sio device     */
+    uint8_t  data;        /* received byte  */
+    uint8_t  reserved[5]; /* reserved       */
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::vm_snapshot
+// ---------------------------------------------------------------------------
+
+namespace {
+
+constexpr char     VM_SNAPSHOT_MAGIC[8] = { 'V', 'Z', '8', '0', 'S', 'N', 'A', 'P' };
+constexpr char     VM_DELTA_MAGIC[8]    = { 'V', 'Z', '8', '0', 'D', 'L', 'T', 'A' };
+constexpr uint32_t VM_SNAPSHOT_VERSION  = 4;
+
+struct SnapshotHeader
+{
+    char     magic[8]; /* file magic        */
+    uint32_t version;  /* format version    */
+    uint32_t length;   /* snapshot length   */
+    uint64_t ident;    /* checkpoint ident  */
+    uint64_t parent;   /* parent checkpoint */
+};
+
+struct SnapshotDelta
+{
+    emu::VirtualMachineState state;       /* machine state      */
+    emu::SchedulerState      scheduler;   /* scheduler state    */
+    cpu::State               cpu;         /* cpu state          */
+    uint32_t                 cpu_signals; /* cpu signals        */
+    vdu::State               vdu;         /* vdu state          */
+    sio::State               sio0;        /* sio #0 state       */
+    sio::State               sio1;        /* sio #1 state       */
+    uint8_t                  mmu_page[4]; /* mmu page registers */
+    uint8_t                  mmu_paging;  /* mmu paging enable  */
+    uint32_t                 count;       /* dirty page count   */
+};
+
+struct SnapshotPage
+{
+    uint32_t index;     /* physical page */
+    uint8_t  data[256]; /* page data     */
+};
+
+auto make_ident() -> uint64_t
+{
+    std::random_device device;
+    uint64_t           ident = 0;
+
+    while(ident == 0) {
+        ident = (static_cast<uint64_t>(device()) << 32) | static_cast<uint64_t>(device());
+    }
+    return ident;
+}
+
+auto restore_sio(sio::Instance& sio, const sio::State& state) -> void
+{
+    sio::State& current(*sio.operator->());
+    sio::State  restored(state);
+    restored.rx      = current.rx;
+    restored.tx      = current.tx;
+    restored.rx_fifo = current.rx_fifo;
+    restored.rx_flow = current.rx_flow;
+    current = restored;
+}
+
+}
+
+// ---------------------------------------------------------------------------
+// emu::SnapshotReader
+// ---------------------------------------------------------------------------
+
+namespace emu {
+
+class SnapshotReader
+{
+public: // public interface
+    SnapshotReader(const std::string& filename)
+        : _filename(filename)
+        , _stream(::fopen(_filename.c_str(), "rb"))
+    {
+        if(_stream == nullptr) {
+            throw std::runtime_error("fopen() has failed");
+        }
+    }
+
+    virtual ~SnapshotReader()
+    {
+        if(_stream != nullptr) {
+            _stream = (::fclose(_stream), nullptr);
+        }
+    }
+
+    auto load(VirtualMachineSnapshot& snapshot) -> SnapshotHeader
+    {
+        const SnapshotHeader header(load_header(VM_SNAPSHOT_MAGIC));
+        if(header.length != sizeof(snapshot)) {
+            throw std::runtime_error("load() has failed (bad length)");
+        }
+        read(&snapshot, sizeof(snapshot));
+        return header;
+    }
+
+    auto load_delta(SnapshotDelta& delta, std::vector<SnapshotPage>& pages) -> SnapshotHeader
+    {
+        const SnapshotHeader header(load_header(VM_DELTA_MAGIC));
+        read(&delta, sizeof(delta));
+        if(header.length != (sizeof(delta) + (delta.count * sizeof(SnapshotPage)))) {
+            throw std::runtime_error("load_delta() has failed (bad length)");
+        }
+        pages.resize(delta.count);
+        for(auto& page : pages) {
+            read(&page, sizeof(page));
+        }
+        return header;
+    }
+
+private: // private interface
+    auto load_header(const char* magic) -> SnapshotHeader
+    {
+        SnapshotHeader header;
+        read(&header, sizeof(header));
+        if(::memcmp(header.magic, magic, sizeof(header.magic)) != 0) {
+            throw std::runtime_error("load() has failed (bad magic)");
+        }
+        if(header.version != VM_SNAPSHOT_VERSION) {
+            throw std::runtime_error("load() has failed (unsupported version)");
+        }
+        return header;
+    }
+
+    auto read(void* buffer, size_t length) -> void
+    {
+        if(::fread(buffer, length, 1, _stream) != 1) {
+            throw std::runtime_error("fread() has failed");
+        }
+    }
+
+private: // private data
+    const std::string _filename;
+    FILE*             _stream;
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// emu::SnapshotWriter
+// ---------------------------------------------------------------------------
+
+namespace emu {
+
+class SnapshotWriter
+{
+public: // public interface
+    SnapshotWriter(const std::string& filename)
+        : _filename(filename)
+        , _stream(::fopen(_filename.c_str(), "wb"))
+    {
+        if(_stream == nullptr) {
+            throw std::runtime_error("fopen() has failed");
+        }
+    }
+
+    virtual ~SnapshotWriter()
+    {
+        if(_stream != nullptr) {
+            _stream = (::fclose(_stream), nullptr);
+        }
+    }
+
+    auto save(const VirtualMachineSnapshot& snapshot, uint64_t ident) -> void
+    {
+        save_header(VM_SNAPSHOT_MAGIC, sizeof(snapshot), ident, 0);
+        write(&snapshot, sizeof(snapshot));
+    }
+
+    auto save_delta(const SnapshotDelta& delta, const std::vector<SnapshotPage>& pages, uint64_t ident, uint64_t parent) -> void
+    {
+        save_header(VM_DELTA_MAGIC, (sizeof(delta) + (delta.count * sizeof(SnapshotPage))), ident, parent);
+        write(&delta, sizeof(delta));
+        for(auto& page : pages) {
+            write(&page, sizeof(page));
+        }
+    }
+
+private: // private interface
+    auto save_header(const char* magic, uint32_t length, uint64_t ident, uint64_t parent) -> void
+    {
+        SnapshotHeader header;
+        static_cast<void>(::memcpy(header.magic, magic, sizeof(header.magic)));
+        header.version = VM_SNAPSHOT_VERSION;
+        header.length  = length;
+        header.ident   = ident;
+        header.parent  = parent;
+        write(&header, sizeof(header));
+    }
+
+    auto write(const void* buffer, size_t length) -> void
+    {
+        if(::fwrite(buffer, length, 1, _stream) != 1) {
+            throw std::runtime_error("fwrite() has failed");
+        }
+    }
+
+private: // private data
+    const std::string _filename;
+    FILE*             _stream;
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// emu::InputRecorder
+// ---------------------------------------------------------------------------
+
+namespace emu {
+
+class InputRecorder
+{
+public: // public interface
+    InputRecorder(const std::string& filename)
+        : _filename(filename)
+        , _stream(::fopen(_filename.c_str(), "wb"))
+        , _offset(0)
+    {
+        if(_stream == nullptr) {
+            throw std::runtime_error("fopen() has failed");
+        }
+        InputHeader header;
+        static_cast<void>(::memset(&header, 0, sizeof(header)));
+        static_cast<void>(::memcpy(header.magic, VM_INPUT_MAGIC, sizeof(header.magic)));
+        header.version = VM_INPUT_VERSION;
+        write(&header, sizeof(header));
+        record_end(0);
+    }
+
+    virtual ~InputRecorder()
+    {
+        if(_stream != nullptr) {
+            _stream = (::fclose(_stream), nullptr);
+        }
+    }
+
+    auto record_byte(uint64_t time, uint8_t device, uint8_t data) -> void
+    {
+        write_record(time, VM_INPUT_BYTE, device, data);
+        _offset += sizeof(InputRecord);
+        record_end(time);
+    }
+
+    auto record_end(uint64_t time) -> void
+    {
+        write_record(time, VM_INPUT_END, 0, 0);
+        if(::fflush(_stream) != 0) {
+            throw std::runtime_error("fflush() has failed");
+        }
+    }
+
+private: // private interface
+    auto write_record(uint64_t time, uint8_t type, uint8_t device, uint8_t data) -> void
+    {
+        InputRecord record;
+        static_cast<void>(::memset(&record, 0, sizeof(record)));
+        record.time   = time;
+        record.type   = type;
+        record.device = device;
+        record.data   = data;
+        if(::fseeko(_stream, sizeof(InputHeader) + _offset, SEEK_SET) != 0) {
+            throw std::runtime_error("fseeko() has failed");
+        }
+        write(&record, sizeof(record));
+    }
+
+    auto write(const void* buffer, size_t length) -> void
+    {
+        if(::fwrite(buffer, length, 1, _stream) != 1) {
+            throw std::runtime_error("fwrite() has failed");
+        }
+    }
+
+private: // private data
+    const std::string _filename;
+    FILE*             _stream;
+    off_t             _offset;
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// emu::InputPlayer
+// ---------------------------------------------------------------------------
+
+namespace emu {
+
+class InputPlayer
+{
+public: // public interface
+    InputPlayer(const std::string& filename)
+        : _filename(filename)
+        , _records()
+        , _index(0)
+    {
+        FILE* stream = ::fopen(_filename.c_str(), "rb");
+        if(stream == nullptr) {
+            throw std::runtime_error("fopen() has failed");
+        }
+        InputHeader header;
+        InputRecord record;
+        if(::fread(&header, sizeof(header), 1, stream) != 1) {
+            stream = (::fclose(stream), nullptr);
+            throw std::runtime_error("fread() has failed");
+        }
+        if((::memcmp(header.magic, VM_INPUT_MAGIC, sizeof(header.magic)) != 0) || (header.version != VM_INPUT_VERSION)) {
+            stream = (::fclose(stream), nullptr);
+            throw std::runtime_error("InputPlayer() has failed (bad header)");
+        }
+        while(::fread(&record, sizeof(record), 1, stream) == 1) {
+            _records.push_back(record);
+        }
+        stream = (::fclose(stream), nullptr);
+    }
+
+    virtual ~InputPlayer() = default;
+
+    auto play(uint64_t time, uint8_t device, uint8_t& data) -> bool
+    {
+        if(_index < _records.size()) {
+            const InputRecord& record(_records[_index]);
+            if((record.type == VM_INPUT_BYTE) && (record.device == device) && (record.time <= time)) {
+                data = record.data;
+                ++_index;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    auto finished(uint64_t time) const -> bool
+    {
+        if(_index < _records.size()) {
+            const InputRecord& record(_records[_index]);
+            if((record.type == VM_INPUT_END) && (record.time <= time)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private: // private data
+    const std::string        _filename;
+    std::vector<InputRecord> _records;
+    size_t                   _index;
+};
+
+}
+
 // ---------------------------------------------------------------------------
 // emu::VirtualMachine
 // ---------------------------------------------------------------------------
@@ -39,16 +448,34 @@ namespace emu {
 VirtualMachine::VirtualMachine(VirtualMachineIface& iface)
     : _iface(iface)
     , _state()
+    , _scheduler()
     , _cpu(*this)
-    , _mmu(*this)
+    , _mmu(*this, (iface.get("memory") == "512k"))
     , _vdu(*this)
-    , _sio0(*this,  0,  1)
-    , _sio1(*this, -1, -1)
+    , _sio0(*this, std::stoi(iface.get("sio0.rx")), std::stoi(iface.get("sio0.tx")), (iface.get("sio.polled") == "yes"))
+    , _sio1(*this, -1, -1, (iface.get("sio.polled") == "yes"))
+    , _checkpoint(0)
+    , _history()
+    , _recorder()
+    , _player()
 {
+    const std::string record(iface.get("record"));
+    const std::string replay(iface.get("replay"));
+    if(record.empty() == false) {
+        _recorder.reset(new InputRecorder(record));
+    }
+    if(replay.empty() == false) {
+        _player.reset(new InputPlayer(replay));
+    }
+    _cpu.set_rd_pages(_mmu.rd_pages());
+    _vdu->hsync = 0;
 }
 
 VirtualMachine::~VirtualMachine()
 {
+    if(_recorder != nullptr) {
+        _recorder->record_end(time());
+    }
     _sio0.print('\n');
     _sio1.print('\n');
 }
@@ -66,6 +493,7 @@ auto VirtualMachine::reset() -> void
         _state.max_clock &= 0;
         _state.hlt_count &= 0;
         _state.wdt_count &= 0;
+        _state.epoch     += _scheduler.now();
         _state.stopped    = false;
         _state.ready      = false;
 
@@ -80,6 +508,19 @@ auto VirtualMachine::reset() -> void
         }
     };
 
+    auto reset_scheduler = [&]() -> void
+    {
+        _scheduler.reset();
+        schedule(VM_EVENT_VDU, _state.vdu_ticks, _state.vdu_clock, _vdu.next());
+        schedule(VM_EVENT_SIO, _state.sio_ticks, _state.sio_clock, 1);
+#ifdef ENABLE_WATCHDOG
+        _scheduler.insert(VM_EVENT_WDT, (_state.wdt_count != 0 ? _state.wdt_count : UINT64_C(0x100000000)));
+#endif
+        if(_history.interval != 0) {
+            _scheduler.insert(VM_EVENT_CHK, _history.interval);
+        }
+    };
+
     auto reset_cpu = [&]() -> void
     {
         _cpu.reset();
@@ -88,10 +529,15 @@ auto VirtualMachine::reset() -> void
     auto reset_mmu = [&]() -> void
     {
         _mmu.reset();
-        _mmu.load_bank(_iface.get("bank0"), 0);
-        _mmu.load_bank(_iface.get("bank1"), 1);
-        _mmu.load_bank(_iface.get("bank2"), 2);
-        _mmu.load_bank(_iface.get("bank3"), 3);
+        if(_mmu.paged() != false) {
+            _mmu.load_rom(_iface.get("bank0"));
+        }
+        else {
+            _mmu.load_bank(_iface.get("bank0"), 0);
+            _mmu.load_bank(_iface.get("bank1"), 1);
+            _mmu.load_bank(_iface.get("bank2"), 2);
+            _mmu.load_bank(_iface.get("bank3"), 3);
+        }
     };
 
     auto reset_vdu = [&]() -> void
@@ -101,6 +547,12 @@ auto VirtualMachine::reset() -> void
 
     auto reset_sio = [&]() -> void
     {
+        const uint32_t fifo = std::stoul(_iface.get("fifo"));
+        const uint8_t  flow = (_iface.get("rtscts") == "yes" ? 1 : 0);
+        _sio0->rx_fifo = fifo;
+        _sio0->rx_flow = flow;
+        _sio1->rx_fifo = fifo;
+        _sio1->rx_flow = flow;
         _sio0.reset();
         _sio1.reset();
     };
@@ -112,6 +564,7 @@ auto VirtualMachine::reset() -> void
         reset_mmu();
         reset_vdu();
         reset_sio();
+        reset_scheduler();
     };
 
     return reset_all();
@@ -120,29 +573,12 @@ auto VirtualMachine::reset() -> void
 auto VirtualMachine::clock() -> void
 {
     if((_state.ready = _state.stopped) == false) {
-        const uint32_t cpu_clock = _state.cpu_clock;
-        const uint32_t vdu_clock = _state.vdu_clock;
-        const uint32_t sio_clock = _state.sio_clock;
-        const uint32_t max_clock = _state.max_clock;
         do {
-            if((_state.cpu_ticks += cpu_clock) >= max_clock) {
-                _state.cpu_ticks -= max_clock;
-                _cpu.clock();
+            const SchedulerEvent event(_scheduler.pop());
+            run_cpu(event.time);
+            if(_state.stopped == false) {
+                dispatch(event);
             }
-            if((_state.vdu_ticks += vdu_clock) >= max_clock) {
-                _state.vdu_ticks -= max_clock;
-                _vdu.clock();
-            }
-            if((_state.sio_ticks += sio_clock) >= max_clock) {
-                _state.sio_ticks -= max_clock;
-                _sio0.clock();
-                _sio1.clock();
-            }
-#ifdef ENABLE_WATCHDOG
-            if(--_state.wdt_count == 0) {
-                reset();
-            }
-#endif
         } while((_state.ready | _state.stopped) == false);
     }
 }
@@ -152,32 +588,582 @@ auto VirtualMachine::stop() -> void
     if(_state.stopped == false) {
         _state.stopped = true;
         _state.ready   = true;
-        _iface.quit();
+        _cpu.cancel();
+        if(_history.replaying == false) {
+            _iface.quit();
+        }
     }
 }
 
-auto VirtualMachine::cpu_mreq_m1(cpu::Instance& cpu, uint16_t addr, uint8_t data) -> uint8_t
+/*
+ * with polled serial ports ("sio.polled"), the embedder moves the bytes
+ * between the descriptors and the queues by calling service() around each
+ * clock(). idle() tells that the cpu is spinning (or halted) while no byte
+ * is in flight, the guest can then be parked until its input is readable.
+ * blocked() tells that the output descriptor did not accept everything.
+ */
+
+auto VirtualMachine::service() -> void
 {
-    return _mmu.rd_byte(addr, data);
+    _sio0.service();
+    _sio1.service();
 }
 
-auto VirtualMachine::cpu_mreq_rd(cpu::Instance& cpu, uint16_t addr, uint8_t data) -> uint8_t
+auto VirtualMachine::idle() const -> bool
 {
-    return _mmu.rd_byte(addr, data);
+    return _cpu.idle() && _sio0.idle() && _sio1.idle();
 }
 
-auto VirtualMachine::cpu_mreq_wr(cpu::Instance& cpu, uint16_t addr, uint8_t data) -> uint8_t
+auto VirtualMachine::blocked() const -> bool
 {
-    return _mmu.wr_byte(addr, data);
+    return _sio0.tx_pending() || _sio1.tx_pending();
 }
 
-auto VirtualMachine::cpu_iorq_m1(cpu::Instance& cpu, uint16_t port, uint8_t data) -> uint8_t
+/*
+ * a snapshot is a plain copy of the state of every device, the signals
+ * latched by the cpu and the pending events. it is meant to be taken between
+ * two calls to clock(). the host side of the serial ports (file descriptors,
+ * fifo size and flow control) belongs to the running machine and is kept as
+ * is on restore, and the cpu caches are flushed since the memory has been
+ * replaced behind its back. a machine may be restored without being reset,
+ * which makes forking many runs from a single snapshot cheap. the file
+ * format is the snapshot preceded by a small header (magic, version, length
+ * and checkpoint idents), it is bound to the host that wrote it and the
+ * version must be bumped whenever the layout of one of the states changes.
+ *
+ * saving or loading a snapshot file makes it the current checkpoint and arms
+ * the dirty page tracking of the mmu. a delta file then holds the state of
+ * every device but only the 256-byte pages of memory written since the last
+ * checkpoint, and becomes the current checkpoint in turn. each delta names
+ * its parent, so a chain of deltas may only be loaded in order on top of its
+ * base snapshot.
+ */
+
+auto VirtualMachine::snapshot(VirtualMachineSnapshot& snapshot) -> void
+{
+    snapshot.state       = _state;
+    snapshot.scheduler   = *_scheduler.operator->();
+    snapshot.cpu         = *_cpu.operator->();
+    snapshot.cpu_signals = _cpu.get_signals();
+    snapshot.mmu         = *_mmu.operator->();
+    snapshot.vdu         = *_vdu.operator->();
+    snapshot.sio0        = *_sio0.operator->();
+    snapshot.sio1        = *_sio1.operator->();
+}
+
+auto VirtualMachine::restore(const VirtualMachineSnapshot& snapshot) -> void
+{
+    rollback(snapshot);
+    clear_history();
+}
+
+auto VirtualMachine::rollback(const VirtualMachineSnapshot& snapshot) -> void
+{
+    _state                   = snapshot.state;
+    *_scheduler.operator->() = snapshot.scheduler;
+    *_cpu.operator->()       = snapshot.cpu;
+    *_mmu.operator->()       = snapshot.mmu;
+    *_vdu.operator->()       = snapshot.vdu;
+    _mmu.untrack_dirty();
+    _cpu.set_signals(snapshot.cpu_signals);
+    _cpu.flush();
+    restore_sio(_sio0, snapshot.sio0);
+    restore_sio(_sio1, snapshot.sio1);
+}
+
+auto VirtualMachine::save(const std::string& filename) -> void
+{
+    std::unique_ptr<VirtualMachineSnapshot> snapshot(new VirtualMachineSnapshot());
+    SnapshotWriter writer(filename);
+    const uint64_t ident = make_ident();
+    this->snapshot(*snapshot);
+    writer.save(*snapshot, ident);
+    _checkpoint = ident;
+    _mmu.track_dirty();
+}
+
+auto VirtualMachine::load(const std::string& filename) -> void
+{
+    std::unique_ptr<VirtualMachineSnapshot> snapshot(new VirtualMachineSnapshot());
+    SnapshotReader reader(filename);
+    const SnapshotHeader header(reader.load(*snapshot));
+    restore(*snapshot);
+    _checkpoint = header.ident;
+    _mmu.track_dirty();
+}
+
+auto VirtualMachine::save_delta(const std::string& filename) -> void
+{
+    std::unique_ptr<SnapshotDelta> delta(new SnapshotDelta());
+    std::vector<SnapshotPage>      pages;
+    const mmu::State&              mmu(*_mmu.operator->());
+
+    auto save_pages = [&]() -> void
+    {
+        const uint8_t* memory = mmu.bank[0].data;
+        for(uint32_t index = 0; index < _mmu.pages(); ++index) {
+            if(_mmu.is_dirty(index) != false) {
+                pages.emplace_back();
+                SnapshotPage& page(pages.back());
+                page.index = index;
+                static_cast<void>(::memcpy(page.data, &memory[index * sizeof(page.data)], sizeof(page.data)));
+            }
+        }
+    };
+
+    auto save_state = [&]() -> void
+    {
+        delta->state       = _state;
+        delta->scheduler   = *_scheduler.operator->();
+        delta->cpu         = *_cpu.operator->();
+        delta->cpu_signals = _cpu.get_signals();
+        delta->vdu         = *_vdu.operator->();
+        delta->sio0        = *_sio0.operator->();
+        delta->sio1        = *_sio1.operator->();
+        delta->mmu_paging  = mmu.paging;
+        delta->count       = pages.size();
+        static_cast<void>(::memcpy(delta->mmu_page, mmu.page, sizeof(delta->mmu_page)));
+    };
+
+    if(_checkpoint == 0) {
+        throw std::runtime_error("save_delta() has failed (no checkpoint)");
+    }
+    SnapshotWriter writer(filename);
+    const uint64_t ident = make_ident();
+    save_pages();
+    save_state();
+    writer.save_delta(*delta, pages, ident, _checkpoint);
+    _checkpoint = ident;
+    _mmu.track_dirty();
+}
+
+auto VirtualMachine::load_delta(const std::string& filename) -> void
+{
+    std::unique_ptr<SnapshotDelta> delta(new SnapshotDelta());
+    std::vector<SnapshotPage>      pages;
+    mmu::State&                    mmu(*_mmu.operator->());
+
+    auto load_pages = [&]() -> void
+    {
+        uint8_t* memory = mmu.bank[0].data;
+        for(auto& page : pages) {
+            if(page.index >= _mmu.pages()) {
+                throw std::runtime_error("load_delta() has failed (bad page)");
+            }
+        }
+        for(auto& page : pages) {
+            static_cast<void>(::memcpy(&memory[page.index * sizeof(page.data)], page.data, sizeof(page.data)));
+        }
+    };
+
+    auto load_state = [&]() -> void
+    {
+        _state                   = delta->state;
+        *_scheduler.operator->() = delta->scheduler;
+        *_cpu.operator->()       = delta->cpu;
+        *_vdu.operator->()       = delta->vdu;
+        mmu.paging               = delta->mmu_paging;
+        static_cast<void>(::memcpy(mmu.page, delta->mmu_page, sizeof(mmu.page)));
+        _cpu.set_signals(delta->cpu_signals);
+        restore_sio(_sio0, delta->sio0);
+        restore_sio(_sio1, delta->sio1);
+    };
+
+    SnapshotReader reader(filename);
+    const SnapshotHeader header(reader.load_delta(*delta, pages));
+    if((_checkpoint == 0) || (header.parent != _checkpoint)) {
+        throw std::runtime_error("load_delta() has failed (not the parent checkpoint)");
+    }
+    load_pages();
+    load_state();
+    _cpu.flush();
+    clear_history();
+    _checkpoint = header.ident;
+    _mmu.track_dirty();
+}
+
+/*
+ * the history is a bounded ring of in-memory checkpoints taken every interval
+ * ticks of the master clock, plus a journal of the outcome of every exchange
+ * with the host side of the serial ports (the bytes received and the stalled
+ * transmits), keyed by the sequence number of the sio clock. everything else
+ * is deterministic, so any point of the timeline back to the oldest checkpoint
+ * is reached by restoring the nearest checkpoint and running the machine
+ * forward, the journal standing for the host up to the furthest point reached
+ * live. while replaying, the transmitted bytes and the trapped characters that
+ * have already been output are not output again. the timeline position is the
+ * number of master ticks since the first reset, the state at a position being
+ * the one reached once every event due at that position has been dispatched.
+ *
+ * step_back() goes back to the start of the previous instruction by stepping
+ * the last few hundred ticks one by one, an instruction starting whenever the
+ * cpu has no pending cycles. run_back() goes back to the start of the last
+ * instruction that has written the given address, by watching the physical
+ * pages that may be mapped at that address while replaying the history from
+ * the newest checkpoint to the oldest, first in chunks then tick by tick.
+ */
+
+auto VirtualMachine::set_history(uint64_t interval, uint32_t capacity) -> void
+{
+    if((interval != 0) && (capacity != 0)) {
+        _history.interval = interval;
+        _history.capacity = capacity;
+    }
+    else {
+        _history.interval = 0;
+        _history.capacity = 0;
+    }
+    clear_history();
+}
+
+auto VirtualMachine::time() const -> uint64_t
+{
+    return _state.epoch + _scheduler.now();
+}
+
+auto VirtualMachine::seek(uint64_t time) -> bool
+{
+    if(time < this->time()) {
+        if(rewind(time) == false) {
+            return false;
+        }
+    }
+    else {
+        advance(time);
+    }
+    return this->time() == time;
+}
+
+auto VirtualMachine::step_back() -> bool
+{
+    const uint64_t target = time();
+    uint64_t       window = VM_STEP_WINDOW;
+
+    auto oldest = [&]() -> uint64_t
+    {
+        if(_history.checkpoints.empty() == false) {
+            return _history.checkpoints.front().time;
+        }
+        return UINT64_MAX;
+    };
+
+    auto find = [&](const uint64_t first, uint64_t& found) -> bool
+    {
+        bool result = false;
+        if(rewind(first) != false) {
+            while((time() < target) && (_state.stopped == false)) {
+                if(_cpu->i_period == 0) {
+                    found  = time();
+                    result = true;
+                }
+                advance(time() + 1);
+            }
+        }
+        return result;
+    };
+
+    while(oldest() < target) {
+        const uint64_t first = ((target - oldest()) > window ? (target - window) : oldest());
+        uint64_t       found = 0;
+        if(find(first, found) != false) {
+            return rewind(found);
+        }
+        if(first == oldest()) {
+            break;
+        }
+        window *= 2;
+    }
+    static_cast<void>(rewind(target));
+    return false;
+}
+
+auto VirtualMachine::run_back(uint16_t addr) -> bool
+{
+    const uint64_t target = time();
+    uint64_t       upper  = target;
+    uint64_t       found  = 0;
+    bool           result = false;
+
+    auto newest_before = [&](const uint64_t time, uint64_t& first) -> bool
+    {
+        bool result = false;
+        for(auto& checkpoint : _history.checkpoints) {
+            if(checkpoint.time < time) {
+                first  = checkpoint.time;
+                result = true;
+            }
+        }
+        return result;
+    };
+
+    auto scan = [&](const uint64_t first, const uint64_t last, const uint64_t chunk, uint64_t& found) -> bool
+    {
+        bool result = false;
+        if(rewind(first) != false) {
+            while((time() < last) && (_state.stopped == false)) {
+                const uint64_t start = time();
+                _history.watched = false;
+                advance(std::min(start + chunk, last));
+                if(_history.watched != false) {
+                    found  = start;
+                    result = true;
+                }
+            }
+        }
+        return result;
+    };
+
+    watch(addr);
+    uint64_t first = 0;
+    while((result == false) && (newest_before(upper, first) != false)) {
+        if(scan(first, upper, VM_WATCH_CHUNK, found) != false) {
+            result = scan(found, std::min(found + VM_WATCH_CHUNK, upper), 1, found);
+        }
+        upper = first;
+    }
+    watch(-1);
+    static_cast<void>(rewind(result != false ? found : target));
+    return result;
+}
+
+/*
+ * every device is driven by an accumulator that is incremented by the device
+ * clock on each tick of the master clock, the device being clocked whenever
+ * the accumulator reaches the master clock. instead of ticking, the number of
+ * master ticks until the count-th overflow is computed and the corresponding
+ * event is inserted into the scheduler, the accumulator being left in the
+ * state it would have after that overflow. the vdu is scheduled straight to
+ * its next sync, the dispatch then advances it by the same number of ticks.
+ */
+
+auto VirtualMachine::schedule(uint32_t type, uint32_t& ticks, uint32_t clock, uint32_t count) -> void
+{
+    const uint64_t max_clock = _state.max_clock;
+    const uint64_t remaining = (max_clock * count) - ticks;
+    const uint64_t delay     = (remaining + (clock - 1)) / clock;
+
+    ticks = static_cast<uint32_t>((ticks + (delay * clock)) - (max_clock * count));
+
+    return _scheduler.insert(type, _scheduler.now() + delay);
+}
+
+auto VirtualMachine::run_cpu(uint64_t time) -> void
+{
+    auto cpu_count = [&](const uint64_t ticks) -> uint64_t
+    {
+        if(_state.cpu_clock != _state.max_clock) {
+            const uint64_t total = _state.cpu_ticks + (ticks * _state.cpu_clock);
+            _state.cpu_ticks = static_cast<uint32_t>(total % _state.max_clock);
+            return total / _state.max_clock;
+        }
+        return ticks;
+    };
+
+    uint64_t count = cpu_count(time - _scheduler.now());
+    while((count != 0) && (_state.stopped == false)) {
+        if(count > UINT32_MAX) {
+            count -= _cpu.run(UINT32_MAX);
+        }
+        else {
+            count -= _cpu.run(static_cast<uint32_t>(count));
+        }
+    }
+    _scheduler.advance(time);
+}
+
+auto VirtualMachine::dispatch(const SchedulerEvent& event) -> void
+{
+    switch(event.type) {
+        case VM_EVENT_VDU:
+            _vdu.clock(_vdu.next());
+            schedule(VM_EVENT_VDU, _state.vdu_ticks, _state.vdu_clock, _vdu.next());
+            break;
+        case VM_EVENT_SIO:
+            if((_history.replaying = (++_state.sio_count <= _history.sio_frontier)) == false) {
+                _history.sio_frontier = _state.sio_count;
+            }
+            _sio0.clock();
+            _sio1.clock();
+            schedule(VM_EVENT_SIO, _state.sio_ticks, _state.sio_clock, 1);
+            if((_player != nullptr) && (_player->finished(time()) != false)) {
+                stop();
+            }
+            break;
+        case VM_EVENT_WDT:
+            reset();
+            break;
+        case VM_EVENT_CHK:
+            if(_history.interval != 0) {
+                _scheduler.insert(VM_EVENT_CHK, _scheduler.now() + _history.interval);
+                checkpoint();
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+auto VirtualMachine::advance(uint64_t time) -> void
+{
+    while((_state.stopped == false) && (this->time() <= time)) {
+        const uint64_t limit = time - _state.epoch;
+        if(_scheduler.next() <= limit) {
+            const SchedulerEvent event(_scheduler.pop());
+            run_cpu(event.time);
+            if(_state.stopped == false) {
+                dispatch(event);
+            }
+        }
+        else {
+            run_cpu(limit);
+            break;
+        }
+    }
+}
+
+auto VirtualMachine::rewind(uint64_t time) -> bool
+{
+    const VirtualMachineCheckpoint* found = nullptr;
+
+    for(auto& checkpoint : _history.checkpoints) {
+        if(checkpoint.time <= time) {
+            found = &checkpoint;
+        }
+    }
+    if(found == nullptr) {
+        return false;
+    }
+    rollback(*found->snapshot);
+    _history.replaying = (_state.sio_count <= _history.sio_frontier);
+    _history.cursor    = 0;
+    while((_history.cursor < _history.journal.size()) && (_history.journal[_history.cursor].sequence <= _state.sio_count)) {
+        ++_history.cursor;
+    }
+    advance(time);
+    return true;
+}
+
+auto VirtualMachine::checkpoint() -> void
+{
+    auto& checkpoints(_history.checkpoints);
+    auto& journal(_history.journal);
+    std::unique_ptr<VirtualMachineSnapshot> snapshot;
+
+    auto evict = [&]() -> void
+    {
+        snapshot = std::move(checkpoints.front().snapshot);
+        checkpoints.erase(checkpoints.begin());
+        const uint64_t sequence = checkpoints.front().snapshot->state.sio_count;
+        auto           last     = journal.begin();
+        while((last != journal.end()) && (last->sequence <= sequence)) {
+            ++last;
+        }
+        const size_t count = (last - journal.begin());
+        journal.erase(journal.begin(), last);
+        _history.cursor -= std::min(_history.cursor, count);
+    };
+
+    if((checkpoints.empty() == false) && (checkpoints.back().time >= time())) {
+        return;
+    }
+    if((checkpoints.size() >= _history.capacity) && (checkpoints.size() > 1)) {
+        evict();
+    }
+    if(snapshot.get() == nullptr) {
+        snapshot.reset(new VirtualMachineSnapshot());
+    }
+    this->snapshot(*snapshot);
+    checkpoints.emplace_back();
+    checkpoints.back().time     = time();
+    checkpoints.back().snapshot = std::move(snapshot);
+}
+
+auto VirtualMachine::clear_history() -> void
+{
+    _history.sio_frontier = _state.sio_count;
+    _history.out_frontier = _state.out_count;
+    _history.replaying    = false;
+    _history.cursor       = 0;
+    _history.checkpoints.clear();
+    _history.journal.clear();
+    _scheduler.remove(VM_EVENT_CHK);
+    if(_history.interval != 0) {
+        _scheduler.insert(VM_EVENT_CHK, _scheduler.now() + _history.interval);
+        checkpoint();
+    }
+}
+
+auto VirtualMachine::record(sio::Instance& sio, uint8_t type, uint8_t data) -> void
+{
+    if(_history.capacity != 0) {
+        VirtualMachineInput input;
+        input.sequence = _state.sio_count;
+        input.device   = (&sio == &_sio0 ? 0 : 1);
+        input.type     = type;
+        input.data     = data;
+        _history.journal.push_back(input);
+    }
+}
+
+auto VirtualMachine::replay(sio::Instance& sio, uint8_t type, uint8_t& data) -> bool
+{
+    const auto&   journal(_history.journal);
+    size_t&       cursor(_history.cursor);
+    const uint8_t device = (&sio == &_sio0 ? 0 : 1);
+
+    while((cursor < journal.size()) && (journal[cursor].sequence < _state.sio_count)) {
+        ++cursor;
+    }
+    if(cursor < journal.size()) {
+        const VirtualMachineInput& input(journal[cursor]);
+        if((input.sequence == _state.sio_count) && (input.device == device) && (input.type == type)) {
+            data = input.data;
+            ++cursor;
+            return true;
+        }
+    }
+    return false;
+}
+
+auto VirtualMachine::watch(int32_t addr) -> void
+{
+    const int32_t  previous = _history.watch;
+    const int32_t  current  = (_history.watch = addr);
+    const uint32_t banks    = (_mmu.pages() / 64);
+
+    auto set_watch = [&](const int32_t addr, const bool enabled) -> void
+    {
+        if(addr >= 0) {
+            for(uint32_t bank = 0; bank < banks; ++bank) {
+                const uint32_t physical   = ((bank << 14) | (addr & 0x3f00));
+                const uint8_t  attributes = _mmu.get_attributes(physical);
+                if(enabled != false) {
+                    _mmu.set_attributes(physical, 1, (attributes | mmu::Instance::PAGE_WWATCH));
+                }
+                else {
+                    _mmu.set_attributes(physical, 1, (attributes & ~mmu::Instance::PAGE_WWATCH));
+                }
+            }
+        }
+    };
+
+    set_watch(previous, false);
+    set_watch(current, true);
+    _history.watched = false;
+}
+
+auto VirtualMachine::cpu_iorq_m1(CpuType& cpu, uint16_t port, uint8_t data) -> uint8_t
 {
     return 0x00;
 }
 
-auto VirtualMachine::cpu_iorq_rd(cpu::Instance& cpu, uint16_t port, uint8_t data) -> uint8_t
+auto VirtualMachine::cpu_iorq_rd(CpuType& cpu, uint16_t port, uint8_t data) -> uint8_t
 {
+    auto is_mmu = [&]() -> bool
+    {
+        return (_mmu.paged() != false) && ((port & 0x00f8) == 0x0078);
+    };
+
     auto rd_sio0 = [&]() -> void
     {
         if((port & 0x00c0) == 0x0080) {
@@ -192,7 +1178,7 @@ auto VirtualMachine::cpu_iorq_rd(cpu::Instance& cpu, uint16_t port, uint8_t data
 
     auto rd_sio1 = [&]() -> void
     {
-        if((port & 0x00c0) == 0x0040) {
+        if(((port & 0x00c0) == 0x0040) && (is_mmu() == false)) {
             if((port & 0x0001) != 0) {
                 data = _sio1.rd_data(data);
             }
@@ -217,8 +1203,13 @@ auto VirtualMachine::cpu_iorq_rd(cpu::Instance& cpu, uint16_t port, uint8_t data
     return iorq_rd();
 }
 
-auto VirtualMachine::cpu_iorq_wr(cpu::Instance& cpu, uint16_t port, uint8_t data) -> uint8_t
+auto VirtualMachine::cpu_iorq_wr(CpuType& cpu, uint16_t port, uint8_t data) -> uint8_t
 {
+    auto is_mmu = [&]() -> bool
+    {
+        return (_mmu.paged() != false) && ((port & 0x00f8) == 0x0078);
+    };
+
     auto wr_sio0 = [&]() -> void
     {
         if((port & 0x00c0) == 0x0080) {
@@ -233,7 +1224,7 @@ auto VirtualMachine::cpu_iorq_wr(cpu::Instance& cpu, uint16_t port, uint8_t data
 
     auto wr_sio1 = [&]() -> void
     {
-        if((port & 0x00c0) == 0x0040) {
+        if(((port & 0x00c0) == 0x0040) && (is_mmu() == false)) {
             if((port & 0x0001) != 0) {
                 data = _sio1.wr_data(data);
             }
@@ -243,6 +1234,13 @@ auto VirtualMachine::cpu_iorq_wr(cpu::Instance& cpu, uint16_t port, uint8_t data
         }
     };
 
+    auto wr_mmu = [&]() -> void
+    {
+        if(is_mmu() != false) {
+            data = _mmu.wr_page(port, data);
+        }
+    };
+
     auto iorq_wr = [&]() -> uint8_t
     {
         if((port & 0x00ff) == 0x0001) {
@@ -251,6 +1249,7 @@ auto VirtualMachine::cpu_iorq_wr(cpu::Instance& cpu, uint16_t port, uint8_t data
             }
         }
         else {
+            wr_mmu();
             wr_sio0();
             wr_sio1();
         }
@@ -262,7 +1261,28 @@ auto VirtualMachine::cpu_iorq_wr(cpu::Instance& cpu, uint16_t port, uint8_t data
 
 auto VirtualMachine::mmu_char_wr(mmu::Instance& mmu, uint8_t data) -> void
 {
-    _sio0.print(data);
+    if(++_state.out_count > _history.out_frontier) {
+        _history.out_frontier = _state.out_count;
+        _sio0.print(data);
+    }
+}
+
+auto VirtualMachine::mmu_page_sw(mmu::Instance& mmu, uint16_t addr, uint32_t size) -> void
+{
+    _cpu.flush(addr, size);
+}
+
+auto VirtualMachine::mmu_page_rd(mmu::Instance& mmu, uint32_t addr, uint8_t data) -> uint8_t
+{
+    return data;
+}
+
+auto VirtualMachine::mmu_page_wr(mmu::Instance& mmu, uint32_t addr, uint8_t data) -> uint8_t
+{
+    if((_history.watch >= 0) && (addr == _mmu.physical(_history.watch))) {
+        _history.watched = true;
+    }
+    return data;
 }
 
 auto VirtualMachine::vdu_sync_hs(vdu::Instance& vdu, bool data) -> void
@@ -273,6 +1293,11 @@ auto VirtualMachine::vdu_sync_hs(vdu::Instance& vdu, bool data) -> void
 auto VirtualMachine::vdu_sync_vs(vdu::Instance& vdu, bool data) -> void
 {
     _state.ready |= true;
+    _sio0.flush();
+    _sio1.flush();
+    if(_recorder != nullptr) {
+        _recorder->record_end(time());
+    }
 }
 
 auto VirtualMachine::sio_intr_rq(sio::Instance& sio) -> void
@@ -280,6 +1305,57 @@ auto VirtualMachine::sio_intr_rq(sio::Instance& sio) -> void
     _cpu.pulse_int();
 }
 
+/*
+ * the recorder logs every byte received from the host with the emulated cycle
+ * (the timeline position) at which it has been handed to the guest. the log
+ * always ends with the cycle at which the session has ended, rewritten on each
+ * byte and each vsync, so it holds even if the process is killed. the player hands the logged bytes at
+ * the same cycles instead of reading the host and stops the machine at the
+ * end of the session. in both modes, a transmit waits for room in the host
+ * queue instead of stalling the guest, so the emulation does not depend on
+ * how fast the host drains the output and the replay does the same work.
+ */
+
+auto VirtualMachine::sio_rx_data(sio::Instance& sio, uint8_t& data) -> bool
+{
+    const uint8_t device = (&sio == &_sio0 ? 0 : 1);
+
+    if(_history.replaying != false) {
+        return replay(sio, VM_INPUT_RX, data);
+    }
+    if(_player != nullptr) {
+        if(_player->play(time(), device, data) == false) {
+            return false;
+        }
+    }
+    else if(sio.receive(data) == false) {
+        return false;
+    }
+    if(_recorder != nullptr) {
+        _recorder->record_byte(time(), device, data);
+    }
+    record(sio, VM_INPUT_RX, data);
+    return true;
+}
+
+auto VirtualMachine::sio_tx_data(sio::Instance& sio, uint8_t data) -> bool
+{
+    if(_history.replaying != false) {
+        return replay(sio, VM_INPUT_TX, data) == false;
+    }
+    if((_recorder != nullptr) || (_player != nullptr)) {
+        while(sio.transmit(data) == false) {
+            std::this_thread::yield();
+        }
+        return true;
+    }
+    if(sio.transmit(data) == false) {
+        record(sio, VM_INPUT_TX, data);
+        return false;
+    }
+    return true;
+}
+
 }
 
 // ---------------------------------------------------------------------------
@@ -21,6 +21,7 @@
 #include "dev/mmu/mmu-core.h"
 #include "dev/vdu/vdu-core.h"
 #include "dev/sio/sio-core.h"
+#include "emu/scheduler.h"
 
 // ---------------------------------------------------------------------------
 // forward declarations
@@ -30,6 +31,8 @@ namespace emu {
 
 class VirtualMachine;
 class VirtualMachineIface;
+class InputRecorder;
+class InputPlayer;
 
 }
 
@@ -50,12 +53,87 @@ struct VirtualMachineState
     uint32_t max_clock = 0;       /* max clock          */
     uint32_t hlt_count = 0;       /* halt request       */
     uint32_t wdt_count = 0;       /* watchdog           */
+    uint64_t epoch     = 0;       /* ticks before reset */
+    uint64_t sio_count = 0;       /* sio clock sequence */
+    uint64_t out_count = 0;       /* trapped characters */
     bool     stopped   = false;   /* emulation stopped  */
     bool     ready     = false;   /* a frame is ready   */
 };
 
 }
 
+// ---------------------------------------------------------------------------
+// emu::VirtualMachineSnapshot
+// ---------------------------------------------------------------------------
+
+namespace emu {
+
+struct VirtualMachineSnapshot
+{
+    VirtualMachineState state;       /* machine state   */
+    SchedulerState      scheduler;   /* scheduler state */
+    cpu::State          cpu;         /* cpu state       */
+    uint32_t            cpu_signals; /* cpu signals     */
+    mmu::State          mmu;         /* mmu state       */
+    vdu::State          vdu;         /* vdu state       */
+    sio::State          sio0;        /* sio #0 state    */
+    sio::State          sio1;        /* sio #1 state    */
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// emu::VirtualMachineInput
+// ---------------------------------------------------------------------------
+
+namespace emu {
+
+struct VirtualMachineInput
+{
+    uint64_t sequence = 0; /* sio clock sequence */
+    uint8_t  device   = 0; /* sio device         */
+    uint8_t  type     = 0; /* input type         */
+    uint8_t  data     = 0; /* input data         */
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// emu::VirtualMachineCheckpoint
+// ---------------------------------------------------------------------------
+
+namespace emu {
+
+struct VirtualMachineCheckpoint
+{
+    uint64_t                                time = 0; /* timeline position */
+    std::unique_ptr<VirtualMachineSnapshot> snapshot; /* machine snapshot  */
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// emu::VirtualMachineHistory
+// ---------------------------------------------------------------------------
+
+namespace emu {
+
+struct VirtualMachineHistory
+{
+    uint64_t                              interval     = 0;     /* checkpoint interval   */
+    uint32_t                              capacity     = 0;     /* checkpoint count      */
+    uint64_t                              sio_frontier = 0;     /* last live sio clock   */
+    uint64_t                              out_frontier = 0;     /* last live character   */
+    bool                                  replaying    = false; /* replaying the journal */
+    size_t                                cursor       = 0;     /* journal cursor        */
+    int32_t                               watch        = -1;    /* watched address       */
+    bool                                  watched      = false; /* watched address hit   */
+    std::vector<VirtualMachineCheckpoint> checkpoints;          /* checkpoint ring       */
+    std::vector<VirtualMachineInput>      journal;              /* input journal         */
+};
+
+}
+
 // ---------------------------------------------------------------------------
 // emu::VirtualMachine
 // ---------------------------------------------------------------------------
@@ -63,8 +141,7 @@ struct VirtualMachineState
 namespace emu {
 
 class VirtualMachine final
-    : private cpu::Interface
-    , private mmu::Interface
+    : private mmu::Interface
     , private vdu::Interface
     , private sio::Interface
 {
@@ -83,22 +160,70 @@ public: // public interface
 
     auto stop() -> void;
 
+    auto service() -> void;
+
+    auto idle() const -> bool;
+
+    auto blocked() const -> bool;
+
+    auto snapshot(VirtualMachineSnapshot&) -> void;
+
+    auto restore(const VirtualMachineSnapshot&) -> void;
+
+    auto save(const std::string& filename) -> void;
+
+    auto load(const std::string& filename) -> void;
+
+    auto save_delta(const std::string& filename) -> void;
+
+    auto load_delta(const std::string& filename) -> void;
+
+    auto set_history(uint64_t interval, uint32_t capacity) -> void;
+
+    auto time() const -> uint64_t;
+
+    auto seek(uint64_t time) -> bool;
+
+    auto step_back() -> bool;
+
+    auto run_back(uint16_t addr) -> bool;
+
+private: // private types
+    friend class cpu::Core<VirtualMachine>;
+
+    using CpuType = cpu::Core<VirtualMachine>;
+
 private: // private cpu interface
-    virtual auto cpu_mreq_m1(cpu::Instance&, uint16_t addr, uint8_t data) -> uint8_t override final;
+    auto cpu_mreq_m1(CpuType&, uint16_t addr, uint8_t data) -> uint8_t
+    {
+        return _mmu.rd_byte(addr, data);
+    }
 
-    virtual auto cpu_mreq_rd(cpu::Instance&, uint16_t addr, uint8_t data) -> uint8_t override final;
+    auto cpu_mreq_rd(CpuType&, uint16_t addr, uint8_t data) -> uint8_t
+    {
+        return _mmu.rd_byte(addr, data);
+    }
 
-    virtual auto cpu_mreq_wr(cpu::Instance&, uint16_t addr, uint8_t data) -> uint8_t override final;
+    auto cpu_mreq_wr(CpuType&, uint16_t addr, uint8_t data) -> uint8_t
+    {
+        return _mmu.wr_byte(addr, data);
+    }
 
-    virtual auto cpu_iorq_m1(cpu::Instance&, uint16_t port, uint8_t data) -> uint8_t override final;
+    auto cpu_iorq_m1(CpuType&, uint16_t port, uint8_t data) -> uint8_t;
 
-    virtual auto cpu_iorq_rd(cpu::Instance&, uint16_t port, uint8_t data) -> uint8_t override final;
+    auto cpu_iorq_rd(CpuType&, uint16_t port, uint8_t data) -> uint8_t;
 
-    virtual auto cpu_iorq_wr(cpu::Instance&, uint16_t port, uint8_t data) -> uint8_t override final;
+    auto cpu_iorq_wr(CpuType&, uint16_t port, uint8_t data) -> uint8_t;
 
 private: // private mmu interface
     virtual auto mmu_char_wr(mmu::Instance&, uint8_t data) -> void override final;
 
+    virtual auto mmu_page_sw(mmu::Instance&, uint16_t addr, uint32_t size) -> void override final;
+
+    virtual auto mmu_page_rd(mmu::Instance&, uint32_t addr, uint8_t data) -> uint8_t override final;
+
+    virtual auto mmu_page_wr(mmu::Instance&, uint32_t addr, uint8_t data) -> uint8_t override final;
+
 private: // private vdu interface
     virtual auto vdu_sync_hs(vdu::Instance&, bool hsync) -> void override final;
 
@@ -107,14 +232,46 @@ private: // private vdu interface
 private: // private sio interface
     virtual auto sio_intr_rq(sio::Instance&) -> void override final;
 
+    virtual auto sio_rx_data(sio::Instance&, uint8_t& data) -> bool override final;
+
+    virtual auto sio_tx_data(sio::Instance&, uint8_t data) -> bool override final;
+
+private: // private interface
+    auto schedule(uint32_t type, uint32_t& ticks, uint32_t clock, uint32_t count) -> void;
+
+    auto run_cpu(uint64_t time) -> void;
+
+    auto dispatch(const SchedulerEvent& event) -> void;
+
+    auto advance(uint64_t time) -> void;
+
+    auto rewind(uint64_t time) -> bool;
+
+    auto checkpoint() -> void;
+
+    auto clear_history() -> void;
+
+    auto rollback(const VirtualMachineSnapshot& snapshot) -> void;
+
+    auto record(sio::Instance& sio, uint8_t type, uint8_t data) -> void;
+
+    auto replay(sio::Instance& sio, uint8_t type, uint8_t& data) -> bool;
+
+    auto watch(int32_t addr) -> void;
+
 private: // private data
-    VirtualMachineIface& _iface;
-    VirtualMachineState  _state;
-    cpu::Instance        _cpu;
-    mmu::Instance        _mmu;
-    vdu::Instance        _vdu;
-    sio::Instance        _sio0;
-    sio::Instance        _sio1;
+    VirtualMachineIface&           _iface;
+    VirtualMachineState            _state;
+    Scheduler                      _scheduler;
+    CpuType                        _cpu;
+    mmu::Instance                  _mmu;
+    vdu::Instance                  _vdu;
+    sio::Instance                  _sio0;
+    sio::Instance                  _sio1;
+    uint64_t                       _checkpoint;
+    VirtualMachineHistory          _history;
+    std::unique_ptr<InputRecorder> _recorder;
+    std::unique_ptr<InputPlayer>   _player;
 };
 
 }
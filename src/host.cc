@@ -0,0 +1,660 @@
+/*
+ * host.cc - Copyright (c) 2001-2026 - Olivier Poncet
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cstdarg>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <string>
+#include <vector>
+#include <iomanip>
+#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include "emu/virtual-machine.h"
+
+// ---------------------------------------------------------------------------
+// <anonymous>::aliases
+// ---------------------------------------------------------------------------
+
+namespace {
+
+using ClockType = std::chrono::steady_clock;
+using TimePoint = std::chrono::time_point<ClockType>;
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::signals
+// ---------------------------------------------------------------------------
+
+namespace {
+
+volatile std::sig_atomic_t g_signal = 0;
+int                        g_wakeup = -1;
+
+auto on_signal(int signum) -> void
+{
+    const uint8_t data = 0;
+    g_signal = signum;
+    if(g_wakeup != -1) {
+        const auto rc = ::write(g_wakeup, &data, sizeof(data));
+        static_cast<void>(rc);
+    }
+}
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::Guest
+// ---------------------------------------------------------------------------
+
+/*
+ * a guest is a virtual machine whose first serial port is bound to a pair of
+ * named pipes, "guest-{N}.in" and "guest-{N}.out". both are opened read-write
+ * and non-blocking: the host never sees an end-of-file when a client goes
+ * away, and the polled serial ports never block a worker. a time slice is a
+ * single frame, with the serial queues serviced before and after it.
+ */
+
+namespace {
+
+class Guest final
+    : private emu::VirtualMachineIface
+{
+public: // public types
+    enum Verdict
+    {
+        GUEST_RUN  = 0, /* keep on running      */
+        GUEST_IDLE = 1, /* park until readable  */
+        GUEST_BUSY = 2, /* park until writable  */
+        GUEST_STOP = 3, /* the guest has halted */
+    };
+
+public: // public interface
+    Guest(const std::string& rom, const std::string& memory, const std::string& path)
+        : parked(false)
+        , rx_armed(false)
+        , tx_armed(false)
+        , slices(0)
+        , parks(0)
+        , _rom(rom)
+        , _memory(memory)
+        , _rx_path(path + ".in")
+        , _tx_path(path + ".out")
+        , _rx(open_fifo(_rx_path))
+        , _tx(open_fifo(_tx_path))
+        , _idle(0)
+        , _quit(false)
+        , _vm(new emu::VirtualMachine(*this))
+    {
+    }
+
+    Guest(const Guest&) = delete;
+
+    Guest& operator=(const Guest&) = delete;
+
+    virtual ~Guest()
+    {
+        _vm.reset();
+        for(auto& path : { _rx_path, _tx_path }) {
+            static_cast<void>(::unlink(path.c_str()));
+        }
+        for(auto fd : { _rx, _tx }) {
+            static_cast<void>(::close(fd));
+        }
+    }
+
+    auto rx() const -> int
+    {
+        return _rx;
+    }
+
+    auto tx() const -> int
+    {
+        return _tx;
+    }
+
+    auto reset() -> void
+    {
+        _vm->reset();
+    }
+
+    auto slice() -> Verdict
+    {
+        _vm->service();
+        _vm->clock();
+        _vm->service();
+        ++slices;
+        if(_quit != false) {
+            return GUEST_STOP;
+        }
+        if(_vm->blocked()) {
+            _idle = 0;
+            return GUEST_BUSY;
+        }
+        if(_vm->idle() == false) {
+            _idle = 0;
+            return GUEST_RUN;
+        }
+        if(++_idle < IDLE_SLICES) {
+            return GUEST_RUN;
+        }
+        _idle = 0;
+        return GUEST_IDLE;
+    }
+
+public: // public data
+    std::atomic<bool> parked;
+    bool              rx_armed;
+    bool              tx_armed;
+    uint64_t          slices;
+    uint64_t          parks;
+
+private: // private vm interface
+    virtual auto loop() -> void override final
+    {
+    }
+
+    virtual auto quit() -> void override final
+    {
+        _quit = true;
+    }
+
+    virtual auto get(const std::string& name) -> std::string override final
+    {
+        if(name == "bank0") {
+            return _rom;
+        }
+        if(name == "bank1") {
+            return "assets/bank1.rom";
+        }
+        if(name == "bank2") {
+            return "assets/bank2.rom";
+        }
+        if(name == "bank3") {
+            return "assets/bank3.rom";
+        }
+        if(name == "sio0.rx") {
+            return std::to_string(_rx);
+        }
+        if(name == "sio0.tx") {
+            return std::to_string(_tx);
+        }
+        if(name == "memory") {
+            return _memory;
+        }
+        if(name == "fifo") {
+            return "4096";
+        }
+        if(name == "rtscts") {
+            return "no";
+        }
+        if(name == "record") {
+            return "";
+        }
+        if(name == "replay") {
+            return "";
+        }
+        if(name == "sio.polled") {
+            return "yes";
+        }
+        throw std::runtime_error("unknown setting");
+    }
+
+private: // private interface
+    static auto open_fifo(const std::string& path) -> int
+    {
+        if((::mkfifo(path.c_str(), 0600) != 0) && (errno != EEXIST)) {
+            throw std::runtime_error(std::string("unable to create") + ' ' + '\'' + path + '\'');
+        }
+        const int fd = ::open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if(fd == -1) {
+            throw std::runtime_error(std::string("unable to open") + ' ' + '\'' + path + '\'');
+        }
+        return fd;
+    }
+
+private: // private data
+    static constexpr uint32_t IDLE_SLICES = 2;
+
+    const std::string                    _rom;
+    const std::string                    _memory;
+    const std::string                    _rx_path;
+    const std::string                    _tx_path;
+    const int                            _rx;
+    const int                            _tx;
+    uint32_t                             _idle;
+    bool                                 _quit;
+    std::unique_ptr<emu::VirtualMachine> _vm;
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::Host
+// ---------------------------------------------------------------------------
+
+/*
+ * the runnable guests are spread over per-worker queues. a worker runs one
+ * slice of the guest at the front of its own queue and requeues it at the
+ * back, and steals from the back of the other queues once its own is empty.
+ * a guest that spins on its serial port for a couple of slices, or whose
+ * output cannot be written, leaves the queues: its descriptor is armed in
+ * an epoll set (one-shot) and the main thread requeues it when it becomes
+ * ready. a parked guest costs nothing but its memory, its emulated time is
+ * frozen until it is woken up. workers without a runnable guest sleep on a
+ * condition variable.
+ */
+
+namespace {
+
+class Host
+{
+public: // public interface
+    Host(unsigned workers)
+        : _guests()
+        , _queues()
+        , _epoll(-1)
+        , _wakeup{-1, -1}
+        , _mutex()
+        , _cond()
+        , _queued(0)
+        , _alive(0)
+        , _quit(false)
+        , _failure()
+    {
+        for(unsigned index = 0; index < (workers != 0 ? workers : 1); ++index) {
+            _queues.emplace_back(new Queue());
+        }
+        if((_epoll = ::epoll_create1(EPOLL_CLOEXEC)) == -1) {
+            throw std::runtime_error("epoll_create1() has failed");
+        }
+        if(::pipe2(_wakeup, O_NONBLOCK | O_CLOEXEC) != 0) {
+            throw std::runtime_error("pipe2() has failed");
+        }
+        control(EPOLL_CTL_ADD, _wakeup[0], EPOLLIN, WAKEUP);
+    }
+
+    Host(const Host&) = delete;
+
+    Host& operator=(const Host&) = delete;
+
+    virtual ~Host()
+    {
+        _guests.clear();
+        for(auto fd : { _epoll, _wakeup[0], _wakeup[1] }) {
+            if(fd != -1) {
+                static_cast<void>(::close(fd));
+            }
+        }
+    }
+
+    auto wakeup() const -> int
+    {
+        return _wakeup[1];
+    }
+
+    auto add(Guest* guest) -> void
+    {
+        _guests.emplace_back(guest);
+    }
+
+    auto run() -> void
+    {
+        std::vector<std::thread> threads;
+
+        auto shutdown = [&]() -> void
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _quit = true;
+            }
+            _cond.notify_all();
+            for(auto& thread : threads) {
+                thread.join();
+            }
+        };
+
+        for(size_t index = 0; index < _guests.size(); ++index) {
+            _guests[index]->reset();
+            push(index, index);
+        }
+        _alive.store(_guests.size());
+        for(size_t index = 0; index < _queues.size(); ++index) {
+            threads.emplace_back([this](const size_t self) -> void { work(self); }, index);
+        }
+        try {
+            poll();
+        }
+        catch(...) {
+            fail(std::current_exception());
+        }
+        shutdown();
+        if(_failure != nullptr) {
+            std::rethrow_exception(_failure);
+        }
+    }
+
+    auto report(double seconds) const -> void
+    {
+        uint64_t slices = 0;
+        uint64_t parks  = 0;
+        for(auto& guest : _guests) {
+            slices += guest->slices;
+            parks  += guest->parks;
+        }
+        rusage usage;
+        static_cast<void>(::getrusage(RUSAGE_SELF, &usage));
+        const double cpu = static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+                         + static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+        std::cout << _guests.size() << ' ' << "guests,"
+                  << ' ' << _queues.size() << ' ' << "workers,"
+                  << ' ' << slices << ' ' << "slices,"
+                  << ' ' << parks << ' ' << "parks,"
+                  << ' ' << std::fixed << std::setprecision(2) << seconds << 's' << ' ' << "wall,"
+                  << ' ' << std::fixed << std::setprecision(2) << cpu << 's' << ' ' << "cpu"
+                  << std::endl;
+    }
+
+private: // private types
+    struct Queue
+    {
+        std::mutex         mutex;
+        std::deque<size_t> guests;
+    };
+
+    static constexpr uint64_t WAKEUP = UINT64_MAX;
+
+private: // private interface
+    auto control(int op, int fd, uint32_t events, uint64_t data) -> void
+    {
+        epoll_event event;
+        event.events   = events;
+        event.data.u64 = data;
+        if(::epoll_ctl(_epoll, op, fd, &event) != 0) {
+            throw std::runtime_error("epoll_ctl() has failed");
+        }
+    }
+
+    auto push(const size_t guest, const size_t hint) -> void
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            ++_queued;
+        }
+        {
+            Queue& queue(*_queues[hint % _queues.size()]);
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.guests.push_back(guest);
+        }
+        _cond.notify_one();
+    }
+
+    auto take(const size_t self, size_t& guest) -> bool
+    {
+        for(size_t offset = 0; offset < _queues.size(); ++offset) {
+            Queue& queue(*_queues[(self + offset) % _queues.size()]);
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if(queue.guests.empty() == false) {
+                if(offset == 0) {
+                    guest = queue.guests.front();
+                    queue.guests.pop_front();
+                }
+                else {
+                    guest = queue.guests.back();
+                    queue.guests.pop_back();
+                }
+                std::lock_guard<std::mutex> count_lock(_mutex);
+                --_queued;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    auto wait() -> bool
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cond.wait(lock, [&]() -> bool { return (_queued != 0) || (_quit != false); });
+        return _quit == false;
+    }
+
+    auto park(const size_t index, const bool writable) -> void
+    {
+        Guest& guest(*_guests[index]);
+        const int  fd     = (writable != false ? guest.tx() : guest.rx());
+        bool&      armed  = (writable != false ? guest.tx_armed : guest.rx_armed);
+        const auto events = (writable != false ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT;
+        ++guest.parks;
+        guest.parked.store(true);
+        control((armed != false ? EPOLL_CTL_MOD : EPOLL_CTL_ADD), fd, events, index);
+        armed = true;
+    }
+
+    auto fail(std::exception_ptr failure) -> void
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if(_failure == nullptr) {
+                _failure = failure;
+            }
+        }
+        const uint8_t data = 0;
+        const auto rc = ::write(_wakeup[1], &data, sizeof(data));
+        static_cast<void>(rc);
+    }
+
+    auto stop() -> void
+    {
+        if(--_alive == 0) {
+            const uint8_t data = 0;
+            const auto rc = ::write(_wakeup[1], &data, sizeof(data));
+            static_cast<void>(rc);
+        }
+    }
+
+    auto work(const size_t self) -> void
+    {
+        size_t index = 0;
+        do {
+            while(take(self, index)) {
+                try {
+                    switch(_guests[index]->slice()) {
+                        case Guest::GUEST_RUN:
+                            push(index, self);
+                            break;
+                        case Guest::GUEST_IDLE:
+                            park(index, false);
+                            break;
+                        case Guest::GUEST_BUSY:
+                            park(index, true);
+                            break;
+                        case Guest::GUEST_STOP:
+                            stop();
+                            break;
+                    }
+                }
+                catch(...) {
+                    fail(std::current_exception());
+                }
+            }
+        } while(wait());
+    }
+
+    auto poll() -> void
+    {
+        epoll_event events[256];
+
+        auto drain = [&]() -> void
+        {
+            uint8_t buffer[64];
+            while(::read(_wakeup[0], buffer, sizeof(buffer)) > 0) {
+                continue;
+            }
+        };
+
+        auto failed = [&]() -> bool
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _failure != nullptr;
+        };
+
+        while((g_signal == 0) && (_alive.load() != 0) && (failed() == false)) {
+            const int count = ::epoll_wait(_epoll, events, 256, -1);
+            if((count < 0) && (errno != EINTR)) {
+                throw std::runtime_error("epoll_wait() has failed");
+            }
+            for(int event = 0; event < count; ++event) {
+                const uint64_t index = events[event].data.u64;
+                if(index == WAKEUP) {
+                    drain();
+                }
+                else if(_guests[index]->parked.exchange(false)) {
+                    push(index, index);
+                }
+            }
+        }
+    }
+
+private: // private data
+    std::vector<std::unique_ptr<Guest>> _guests;
+    std::vector<std::unique_ptr<Queue>> _queues;
+    int                                 _epoll;
+    int                                 _wakeup[2];
+    std::mutex                          _mutex;
+    std::condition_variable             _cond;
+    size_t                              _queued;
+    std::atomic<size_t>                 _alive;
+    bool                                _quit;
+    std::exception_ptr                  _failure;
+};
+
+}
+
+// ---------------------------------------------------------------------------
+// <anonymous>::limits
+// ---------------------------------------------------------------------------
+
+/*
+ * each guest holds two descriptors, the soft limit on open files is raised
+ * to the hard one so that thousands of guests fit in a single process.
+ */
+
+namespace {
+
+auto raise_nofile() -> void
+{
+    rlimit limit;
+    if(::getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        if(limit.rlim_cur < limit.rlim_max) {
+            limit.rlim_cur = limit.rlim_max;
+            static_cast<void>(::setrlimit(RLIMIT_NOFILE, &limit));
+        }
+    }
+}
+
+}
+
+// ---------------------------------------------------------------------------
+// main
+// ---------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+    std::string rom("assets/monitor.rom");
+    std::string memory("64k");
+    std::string dir(".");
+    unsigned    workers = std::thread::hardware_concurrency();
+    unsigned    guests  = 1;
+
+    auto parse = [&]() -> void
+    {
+        for(int argi = 1; argi < argc; ++argi) {
+            const std::string arg(argv[argi]);
+            if(arg.compare(0, 2, "-j") == 0) {
+                workers = std::stoul(arg.substr(2));
+            }
+            else if(arg.compare(0, 2, "-n") == 0) {
+                guests = std::stoul(arg.substr(2));
+            }
+            else if(arg.compare(0, 6, "--dir=") == 0) {
+                dir = arg.substr(6);
+            }
+            else if(arg.compare(0, 9, "--memory=") == 0) {
+                memory = arg.substr(9);
+            }
+            else {
+                rom = arg;
+            }
+        }
+        if((memory != "64k") && (memory != "512k")) {
+            throw std::runtime_error(std::string("invalid memory size") + ' ' + '\'' + memory + '\'');
+        }
+        if((::mkdir(dir.c_str(), 0700) != 0) && (errno != EEXIST)) {
+            throw std::runtime_error(std::string("unable to create") + ' ' + '\'' + dir + '\'');
+        }
+    };
+
+    auto trap = [&](const int wakeup) -> void
+    {
+        g_wakeup = wakeup;
+        static_cast<void>(::signal(SIGINT,  &on_signal));
+        static_cast<void>(::signal(SIGTERM, &on_signal));
+        static_cast<void>(::signal(SIGPIPE, SIG_IGN));
+    };
+
+    try {
+        parse();
+        raise_nofile();
+        Host host(workers);
+        for(unsigned index = 0; index < guests; ++index) {
+            host.add(new Guest(rom, memory, dir + '/' + "guest-" + std::to_string(index)));
+        }
+        trap(host.wakeup());
+        const TimePoint t0(ClockType::now());
+        host.run();
+        const TimePoint t1(ClockType::now());
+        host.report(std::chrono::duration<double>(t1 - t0).count());
+    }
+    catch(const std::exception& e) {
+        std::cerr << "error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+// ---------------------------------------------------------------------------
+// End-Of-File
+// ---------------------------------------------------------------------------